@@ -0,0 +1,99 @@
+#include <chip8.h>
+#include <invalidation.h>
+#include <algorithm>
+
+// Every block ends with an instruction that can move the program counter somewhere else
+// than the next instruction (or that writes in ram), so all the other instructions of the block
+// are always executed one after the other: once the block starting at m_PC is found,
+// its instructions can be executed without fetching and decoding them.
+// The instructions writing in ram end their block, so that if they overwrite their own block
+// (or the next instructions of it), the block is discarded before anything else of it gets executed.
+void Chip8::runBlocks(uint64_t count)
+{
+    BlockCache& cache {*m_blockCache};
+
+    while (count > 0)
+    {
+        const Address pc = m_PC;
+
+        // the last address of the ram can't contain a whole instruction
+        if (pc >= cache.m_decoded.size() - 1)
+        {
+            step();
+            --count;
+            continue;
+        }
+
+        uint8_t length = cache.m_blockLength[pc];
+
+        if (length != 0)
+        {
+            ++cache.m_statistics.m_hits;
+        }
+        else
+        {
+            ++cache.m_statistics.m_misses;
+            length = buildBlock(pc);
+        }
+
+        const uint64_t numInstructions = std::min<uint64_t>(length, count);
+
+        const DecodedInstruction* decoded {&cache.m_decoded[pc]};
+        for (uint64_t i = 0; i < numInstructions; ++i)
+        {
+            decoded->m_handler(*this, *decoded);
+            decoded += 2;
+        }
+
+        count -= numInstructions;
+    }
+}
+
+uint8_t Chip8::buildBlock(const Address pc)
+{
+    BlockCache& cache {*m_blockCache};
+
+    uint8_t length = 0;
+    Address address = pc;
+
+    while (length < BlockCache::MAXIMAL_BLOCK_LENGTH && address < cache.m_decoded.size() - 1)
+    {
+        uint16_t byte1 = static_cast<uint16_t>((*m_ramPtr)[address] << 8u);
+        uint16_t byte2 = static_cast<uint16_t>((*m_ramPtr)[address+1]);
+
+        DecodedInstruction& decoded {cache.m_decoded[address]};
+        decoded = (*m_dispatchTable)[byte1 | byte2];
+
+        cache.m_isCode[address] = true;
+        cache.m_isCode[address+1] = true;
+
+        ++length;
+        address = static_cast<Address>(address + 2);
+
+        if (endsBlock(decoded))
+        {
+            break;
+        }
+    }
+
+    cache.m_blockLength[pc] = length;
+
+    return length;
+}
+
+// the blocks touched by the write are discarded (look at invalidation.h)
+void Chip8::BlockCache::invalidate(const Address first, const Address last)
+{
+    discardOverlappingCode(m_isCode, first, last, MAXIMAL_BLOCK_LENGTH,
+        [this](const size_t start) { return size_t {m_blockLength[start]}; },
+        [this](const size_t start)
+        {
+            m_blockLength[start] = 0;
+            ++m_statistics.m_invalidations;
+        });
+}
+
+Chip8::BlockCacheStatistics Chip8::getBlockCacheStatistics() const
+{
+    return m_blockCache ? m_blockCache->m_statistics : BlockCacheStatistics {};
+}
@@ -1,32 +1,58 @@
 #include "chip8.h"
 #include <read_from_file.h>
 #include <random>
+#include <algorithm>
+#include <bit>
 #include <cassert>
 #include <ranges>
 
-Chip8::Pixel Chip8::Pixel::operator^(Status s)
+bool Chip8::Display::xorRow(const int row, const Row spriteRow)
 {
-    return (int(m_status) ^ int(s))? Chip8::Pixel(Chip8::Status::on, m_fadingLevel)
-        : Chip8::Pixel(Chip8::Status::off, m_fadingLevel);
+    Row turnedOff = m_frame[row] & spriteRow;
+
+    m_frame[row] ^= spriteRow;
+    m_turnedOff[row] |= turnedOff;
+
+    return turnedOff != 0;
 }
 
-void Chip8::Display::decreaseFadingLevel()
+void Chip8::Display::publish(FrameBuffer& frameBuffer)
 {
-    for (std::array<Pixel, DISPLAY_WIDTH>& row : m_frame)
+    FrameBuffer::Frame& frame {frameBuffer.back()};
+
+    frame.m_pixels = m_frame;
+    frame.m_turnedOff = m_turnedOff;
+    frame.m_cleared = m_cleared;
+    frame.m_generation = m_generation;
+
+    const std::array<Row, DISPLAY_HEIGHT> turnedOff {m_turnedOff};
+
+    m_turnedOff = {};
+    m_cleared = false;
+
+    // if the render thread skipped the previous frame, the pixels turned off in it
+    // are passed on to the next frame, so that they fade anyway
+    if (!frameBuffer.publish())
     {
-        for (Pixel& pixel : row)
+        const FrameBuffer::Frame& skipped {frameBuffer.back()};
+
+        m_turnedOff = skipped.m_turnedOff;
+
+        // the render thread still has to clear its fading levels, which would also clear
+        // the ones of the pixels turned off in the frame just published
+        if (skipped.m_cleared)
         {
-            if (pixel.m_fadingLevel > 0 && pixel.m_status == Status::off)
+            m_cleared = true;
+
+            for (int row = 0; row < DISPLAY_HEIGHT; ++row)
             {
-                --pixel.m_fadingLevel;
+                m_turnedOff[row] |= turnedOff[row];
             }
         }
     }
 }
 
-// drwWrap takes ownership of the sprite because it modifies it
-// and it shouldn't be used again after the modifications
-bool Chip8::Display::drwWrap(std::vector<uint8_t>&& sprite, const uint8_t x, const uint8_t y)
+bool Chip8::Display::drwWrap(const std::span<const uint8_t> sprite, const uint8_t x, const uint8_t y)
 {
     bool res = false;
 
@@ -37,38 +63,22 @@ bool Chip8::Display::drwWrap(std::vector<uint8_t>&& sprite, const uint8_t x, con
     // the sprite can be maximum 16 lines long by the chip8 documentation
     assert(size < 16);
 
-    for (size_t row = 0; row < size; ++row)
-    {
-        size_t rowOffset = (y + row) % DISPLAY_HEIGHT;
-
-        for (int column = 7; column >= 0; --column)
-        {
-            size_t columnOffset = (x + column) % DISPLAY_WIDTH;
-
-            Pixel& pixel {m_frame[rowOffset][columnOffset]};
+    ++m_generation;
 
-            bool pixelWasOn = (pixel.m_status == Chip8::Status::on);
-
-            pixel = pixel ^ static_cast<Status>(sprite[row] & 0b1);
-            sprite[row] = sprite[row] >> 1u;
+    for (size_t offset = 0; offset < size; ++offset)
+    {
+        int row = static_cast<int>((y + offset) % DISPLAY_HEIGHT);
 
-            if (pixelWasOn)
-            {
-                pixel.m_fadingLevel = m_maximalFading;
-            }
+        // the byte of the sprite is moved to the leftmost columns and rotated, so that the pixels
+        // over the end of the row come back at its beginning
+        const Row spriteRow = std::rotr(static_cast<Row>(sprite[offset]) << 56u, x);
 
-            if (!res)
-            {
-                res = pixelWasOn && (pixel.m_status == Chip8::Status::off);
-            }
-        }
+        res = xorRow(row, spriteRow) || res;
     }
     return res;
 }
 
-// drwClip takes ownership of the sprite because it modifies it
-// and it shouldn't be used again after the modifications
-bool Chip8::Display::drwClip(std::vector<uint8_t>&& sprite, const uint8_t x, const uint8_t y)
+bool Chip8::Display::drwClip(const std::span<const uint8_t> sprite, const uint8_t x, const uint8_t y)
 {
     bool res = false;
 
@@ -79,47 +89,34 @@ bool Chip8::Display::drwClip(std::vector<uint8_t>&& sprite, const uint8_t x, con
     // the sprite can be maximum 16 lines long by the chip8 documentation
     assert(size < 16);
 
-    int maxWidth = std::min(DISPLAY_WIDTH-1, x+7); // necessary for clipping the sprite if the width exceeds the display
+    ++m_generation;
+
     int maxHeight = std::min(DISPLAY_HEIGHT-y, static_cast<int>(size)); // necessary for clipping the sprite if the height exceeds the display
 
     for (int offset = 0; offset < maxHeight; ++offset)
     {
-        int row = y + offset;
-        for (int column = x; column <= maxWidth; ++column)
-        {
-            Pixel& pixel {m_frame[row][column]};
-
-            bool pixelWasOn = (pixel.m_status == Chip8::Status::on);
-
-            pixel = pixel ^ static_cast<Status>((sprite[offset] & 0b1000'0000) >> 7u);
-            sprite[offset] = static_cast<uint8_t>(sprite[offset] << 1u);
-
-            if (pixelWasOn && pixel.m_status == Status::off)
-            {
-                pixel.m_fadingLevel = m_maximalFading;
-            }
+        // the pixels shifted over the end of the row are clipped
+        const Row spriteRow = (static_cast<Row>(sprite[offset]) << 56u) >> x;
 
-            if (!res)
-            {
-                res = pixelWasOn && (pixel.m_status == Chip8::Status::off);
-            }
-        }
+        res = xorRow(y + offset, spriteRow) || res;
     }
     return res;
 }
 
-// The Chip8 constructor spawns two threads: one for the delay timer and one for the sound timer.
+// In TimerMode::threads, the member function run spawns two threads: one for the delay timer and one for the sound timer
+// (in TimerMode::lazy the timers are computed from the time elapsed, look at currentTick).
 // The class Chip8 has two data members m_delayTimerThread and m_soundTimerThread that are handles
-// for these threads.
+// for these threads. They are not spawned by the constructor, so that a Chip8 which is only
+// executed by runTurbo never starts them (and can be destroyed without waiting for them).
 // These two threads communicate with the chip8 through some condition variables
 // which are also data members of Chip8: m_hasStartedRunning, m_setDelayTimer and m_setSoundTimer.
 // First m_delayTimerThread and m_soundTimerThread use m_hasStartedRunning to check
 // that m_isRunning is set to true (so that the chip8 has started running the rom)
 // and then they continue waiting for the timer to be set through m_setDelayTimer and m_setSoundTimer.
 // These two condition variables are notified by the thread where the chip8 emulator is running.
-// The class Chip8 has another condition variable: m_eventHappened that waits for a keyboard event or
-// a quit event to happen. This condition variable is notified by the main thread,
-// where the keyboard and display are handled.
+// The keyboard is not protected by any mutex: the main thread, where the keyboard and display are handled,
+// writes the keys in m_keyboard, and the instruction ldVxK waits on it for a key to be pressed
+// or for the window to be closed (look at the class Keyboard in chip8.h).
 Chip8::Chip8(
     std::string_view flagChip8Type,
     std::string_view flagDrawInstruction,
@@ -128,11 +125,16 @@ Chip8::Chip8(
     std::function<void()> pauseSoundCallback
     ) :
     m_fadingFlag {(flagFading == "-n") ? Fading::off : Fading::on},
-    m_display {std::make_unique<Display>(m_fadingFlag)},
+    m_display {std::make_unique<Display>()},
+    m_frameBuffer {std::make_unique<FrameBuffer>()},
+    m_keyboard {std::make_unique<Keyboard>()},
     m_playSoundCallback {playSoundCallback},
     m_pauseSoundCallback {pauseSoundCallback},
-    m_instructionSet {(flagChip8Type == "-s") ? InstructionSet::schip8 : InstructionSet::chip8},
-    m_drawBehaviour {(flagDrawInstruction == "-w") ? DrawBehaviour::wrap : DrawBehaviour::clip},
+    m_quirks {
+        (flagChip8Type == "-s") ? InstructionSet::schip8 : InstructionSet::chip8,
+        (flagDrawInstruction == "-w") ? DrawBehaviour::wrap : DrawBehaviour::clip
+    },
+    m_execute {withQuirks(m_quirks, []<Quirks Q>() { return &Chip8::execute<Q>; })},
     m_PC {Address(0x200)} // the first 0x200 addresses in m_ramPtr are not used by the program
 {
     // the first addresses of the m_ramPtr are used for the hexadecimal sprites, so we copy them starting from 0
@@ -154,6 +156,18 @@ void Chip8::readFromFile(const std::filesystem::path& path)
     char* startProgramAddress = &(reinterpret_cast<char&>((*m_ramPtr)[m_PC]));
 
     copyFromBinaryFile(path, startProgramAddress);
+
+    ramWritten(m_PC, static_cast<Address>(m_ramPtr->size() - 1));
+
+    if (m_recompiledCode)
+    {
+        attachRecompiledProgram();
+    }
+
+    if (m_fusions)
+    {
+        fuseInstructions();
+    }
 }
 
 void Chip8::run(std::future<bool>&& futureDisplayInitialized)
@@ -164,50 +178,157 @@ void Chip8::run(std::future<bool>&& futureDisplayInitialized)
     m_hasStartedRunning.notify_all();
     isRunningMutexLock.unlock();
 
+    if (m_timerMode == TimerMode::threads)
+    {
+        m_delayTimerThread = std::jthread {[this] { this->Chip8::decreaseDelayTimer(); }};
+        m_soundTimerThread = std::jthread {[this] { this->Chip8::decreaseSoundTimer(); }};
+    }
+
     futureDisplayInitialized.wait();
 
     // the internal clock of the Chip8 is slower than the internal clock
-    // of a modern computer.
-    // Thus we need to let the execution thread sleep for some time in between instructions
-    // (more below)
-    std::chrono::duration<double, std::milli> sleep_time {0};
+    // of a modern computer, so this thread sleeps after the instructions of every frame (look at m_speed).
+    // The frames are paced by absolute deadlines: the n-th frame ends at start + n*FRAME_PERIOD,
+    // so the time slept in excess by a frame is recovered by the next one instead of adding up
+    m_pacingStatistics = {};
+
+    const auto start = std::chrono::steady_clock::now();
+    auto deadline = start;
+
+    // the ticks of the lazy timers (and the vertical blanks) go on from m_ticks at the start of the first frame,
+    // so that every frame begins right after a tick
+    m_startTime = start - FRAME_PERIOD * static_cast<int64_t>(m_ticks);
+    m_isRealTime = true;
 
     while (m_isRunning)
     {
-        // chip8 has a clock frequency of 500 Hz, so we have to let this thread sleep.
-        // We use the function std::this_tread::sleep_for(sleep_time)
-        // This function grants that the thread will sleep for AT LEAST
-        // sleep_time, but it could sleep a bit more, since it is not super precise.
-        // In order to make the Chip8 clock more precise, I adopted two strategies:
-        // 1) sleep after executing ten instructions at a time, so that
-        // the overall sleeping time in excess is less significant;
-        // 2) take into account the effective time slept in the previous iteration
-        // when computing the sleep_time. I achieved this by starting to
-        // measure the time before the thread sleeps.
-        const auto start = std::chrono::high_resolution_clock::now();
+        const uint64_t instructions {executeFrame(deadline + FRAME_PERIOD)};
+
+        m_display->publish(*m_frameBuffer);
 
-        std::this_thread::sleep_for(sleep_time);
+        // the queue of the keyboard is emptied regularly, so that it never fills up between two fx0a
+        readKeyEdges();
 
-        for (int numInstructions = 0; numInstructions < 10; ++numInstructions)
+        // the sound started by ldSTVx must stop when the lazy sound timer reaches 0
+        if (m_isPlayingSound)
         {
-            // one instruction is given by two bytes each
-            uint16_t byte1 = static_cast<uint16_t>((*m_ramPtr)[m_PC]);
-            byte1 = static_cast<uint16_t>(byte1 << 8u);
+            updateSound();
+        }
 
-            uint16_t byte2 = static_cast<uint16_t>((*m_ramPtr)[m_PC+1]);
+        m_pacingStatistics.m_instructions += instructions;
+        ++m_pacingStatistics.m_frames;
 
-            Chip8::Instruction instruction {static_cast<uint16_t>(byte1 | byte2)};
+        deadline += FRAME_PERIOD;
 
-            execute(instruction);
+        // the uncapped frames end when their time is over, so there is nothing to wait for
+        // (and no frame to catch up after fx0a waited for a key)
+        if (m_speed.m_unit == SpeedUnit::uncapped)
+        {
+            deadline = std::max(deadline, std::chrono::steady_clock::now());
         }
+        else
+        {
+            waitForDeadline(deadline);
+        }
+    }
 
-        const auto end = std::chrono::high_resolution_clock::now();
+    m_ticks = currentTick();
+    m_isRealTime = false;
 
-        sleep_time = std::chrono::milliseconds(20) - (end - start - sleep_time); // 2 milliseconds per instruction
+    const double seconds {std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+    m_pacingStatistics.m_instructionsPerSecond = (seconds > 0) ?
+        static_cast<double>(m_pacingStatistics.m_instructions) / seconds : 0;
+}
+
+void Chip8::step()
+{
+    // one instruction is given by two bytes each
+    uint16_t byte1 = static_cast<uint16_t>((*m_ramPtr)[m_PC]);
+    byte1 = static_cast<uint16_t>(byte1 << 8u);
+
+    uint16_t byte2 = static_cast<uint16_t>((*m_ramPtr)[m_PC+1]);
 
+    Chip8::Instruction instruction {static_cast<uint16_t>(byte1 | byte2)};
+
+    if (m_engine == Engine::switchCase)
+    {
+        (this->*m_execute)(instruction);
+    }
+    else
+    {
+        const DecodedInstruction& decoded {(*m_dispatchTable)[instruction.m_inst]};
+        decoded.m_handler(*this, decoded);
     }
 }
 
+void Chip8::executeInstructions(const uint64_t count)
+{
+    // waiting for the delay timer doesn't need any engine (look at idle.cpp)
+    if (skipIdleLoop(count))
+    {
+        return;
+    }
+
+    if (m_engine == Engine::blockCache)
+    {
+        runBlocks(count);
+        return;
+    }
+
+    if (m_engine == Engine::jit)
+    {
+        runJit(count);
+        return;
+    }
+
+    if (m_engine == Engine::recompiled)
+    {
+        runRecompiled(count);
+        return;
+    }
+
+    if (m_engine == Engine::fused)
+    {
+        runFused(count);
+        return;
+    }
+
+    if (m_engine == Engine::threaded)
+    {
+        (this->*m_runThreaded)(count);
+        return;
+    }
+
+    for (uint64_t numInstructions = 0; numInstructions < count; ++numInstructions)
+    {
+        step();
+    }
+}
+
+void Chip8::ramWritten(const Address first, const Address last)
+{
+    if (m_blockCache)
+    {
+        m_blockCache->invalidate(first, last);
+    }
+
+    if (m_jit)
+    {
+        m_jit->invalidate(first, last);
+    }
+
+    if (m_recompiledCode)
+    {
+        m_recompiledCode->invalidate(first, last);
+    }
+
+    if (m_fusions)
+    {
+        m_fusions->invalidate(first, last);
+    }
+}
+
+template <Chip8::Quirks Q>
 void Chip8::execute(const Chip8::Instruction i)
 {
     uint16_t instruction = i.m_inst;
@@ -246,40 +367,45 @@ void Chip8::execute(const Chip8::Instruction i)
 
     case 3:
     {
-        uint16_t xkk = static_cast<uint16_t>(instruction & 0xfff);
-        se(xkk);
+        uint8_t x = (instruction & 0xf00) >> 8u;
+        uint8_t kk = static_cast<uint8_t>(instruction & 0xff);
+        se(x, kk);
         m_PC = static_cast<Address>(m_PC + 2);
         break;
     }
 
     case 4:
     {
-        uint16_t xkk = static_cast<uint16_t>(instruction & 0xfff);
-        sne(xkk);
+        uint8_t x = (instruction & 0xf00) >> 8u;
+        uint8_t kk = static_cast<uint8_t>(instruction & 0xff);
+        sne(x, kk);
         m_PC = static_cast<Address>(m_PC + 2);
         break;
     }
 
     case 5:
     {
-        uint8_t xy0 = static_cast<uint8_t>((instruction & 0xff0) >> 4u);
-        se(xy0);
+        uint8_t x = (instruction & 0xf00) >> 8u;
+        uint8_t y = (instruction & 0xf0) >> 4u;
+        seVxVy(x, y);
         m_PC = static_cast<Address>(m_PC + 2);
         break;
     }
 
     case 6:
     {
-        uint16_t xkk = static_cast<uint16_t>(instruction & 0xfff);
-        ld(xkk);
+        uint8_t x = (instruction & 0xf00) >> 8u;
+        uint8_t kk = static_cast<uint8_t>(instruction & 0xff);
+        ld(x, kk);
         m_PC = static_cast<Address>(m_PC + 2);
         break;
     }
 
     case 7:
     {
-        uint16_t xkk = static_cast<uint16_t>(instruction & 0xfff);
-        add(xkk);
+        uint8_t x = (instruction & 0xf00) >> 8u;
+        uint8_t kk = static_cast<uint8_t>(instruction & 0xff);
+        add(x, kk);
         m_PC = static_cast<Address>(m_PC + 2);
         break;
     }
@@ -291,72 +417,81 @@ void Chip8::execute(const Chip8::Instruction i)
         {
         case 0:
         {
-            uint8_t xy = static_cast<uint8_t>((instruction & 0xff0) >> 4u);
-            ld(xy);
+            uint8_t x = (instruction & 0xf00) >> 8u;
+            uint8_t y = (instruction & 0xf0) >> 4u;
+            ldVxVy(x, y);
             m_PC = static_cast<Address>(m_PC + 2);
             break;
         }
 
         case 1:
         {
-            uint8_t xy = static_cast<uint8_t>((instruction & 0xff0) >> 4u);
-            bitOr(xy);
+            uint8_t x = (instruction & 0xf00) >> 8u;
+            uint8_t y = (instruction & 0xf0) >> 4u;
+            bitOr(x, y);
             m_PC = static_cast<Address>(m_PC + 2);
             break;
         }
 
         case 2:
         {
-            uint8_t xy = static_cast<uint8_t>((instruction & 0xff0) >> 4u);
-            bitAnd(xy);
+            uint8_t x = (instruction & 0xf00) >> 8u;
+            uint8_t y = (instruction & 0xf0) >> 4u;
+            bitAnd(x, y);
             m_PC = static_cast<Address>(m_PC + 2);
             break;
         }
 
         case 3:
         {
-            uint8_t xy = static_cast<uint8_t>((instruction & 0xff0) >> 4u);
-            bitXor(xy);
+            uint8_t x = (instruction & 0xf00) >> 8u;
+            uint8_t y = (instruction & 0xf0) >> 4u;
+            bitXor(x, y);
             m_PC = static_cast<Address>(m_PC + 2);
             break;
         }
 
         case 4:
         {
-            uint8_t xy = static_cast<uint8_t>((instruction & 0xff0) >> 4u);
-            add(xy);
+            uint8_t x = (instruction & 0xf00) >> 8u;
+            uint8_t y = (instruction & 0xf0) >> 4u;
+            addVxVy(x, y);
             m_PC = static_cast<Address>(m_PC + 2);
             break;
         }
 
         case 5:
         {
-            uint8_t xy = static_cast<uint8_t>((instruction & 0xff0) >> 4u);
-            sub(xy);
+            uint8_t x = (instruction & 0xf00) >> 8u;
+            uint8_t y = (instruction & 0xf0) >> 4u;
+            sub(x, y);
             m_PC = static_cast<Address>(m_PC + 2);
             break;
         }
 
         case 6:
         {
-            uint8_t xy = static_cast<uint8_t>((instruction & 0xff0) >> 4u);
-            shr(xy);
+            uint8_t x = (instruction & 0xf00) >> 8u;
+            uint8_t y = (instruction & 0xf0) >> 4u;
+            shr<Q>(x, y);
             m_PC = static_cast<Address>(m_PC + 2);
             break;
         }
 
         case 7:
         {
-            uint8_t xy = static_cast<uint8_t>((instruction & 0xff0) >> 4u);
-            subn(xy);
+            uint8_t x = (instruction & 0xf00) >> 8u;
+            uint8_t y = (instruction & 0xf0) >> 4u;
+            subn(x, y);
             m_PC = static_cast<Address>(m_PC + 2);
             break;
         }
 
         case 0xe:
         {
-            uint8_t xy = static_cast<uint8_t>((instruction & 0xff0) >> 4u);
-            shl(xy);
+            uint8_t x = (instruction & 0xf00) >> 8u;
+            uint8_t y = (instruction & 0xf0) >> 4u;
+            shl<Q>(x, y);
             m_PC = static_cast<Address>(m_PC + 2);
             break;
         }
@@ -374,8 +509,9 @@ void Chip8::execute(const Chip8::Instruction i)
         {
             case 0:
             {
-                uint8_t xy =  static_cast<uint8_t>((instruction & 0xff0) >> 4u);
-                sne(xy);
+                uint8_t x = (instruction & 0xf00) >> 8u;
+                uint8_t y = (instruction & 0xf0) >> 4u;
+                sneVxVy(x, y);
                 m_PC = static_cast<Address>(m_PC + 2);
                 break;
             }
@@ -403,21 +539,26 @@ void Chip8::execute(const Chip8::Instruction i)
 
     case 0xc:
     {
-        uint16_t xkk = instruction & 0xfff;
-        rnd(xkk);
+        uint8_t x = (instruction & 0xf00) >> 8u;
+        uint8_t kk = static_cast<uint8_t>(instruction & 0xff);
+        rnd(x, kk);
         m_PC = static_cast<Address>(m_PC + 2);
         break;
     }
 
     case 0xd:
     {
-        uint16_t xyn = instruction & 0xfff;
+        uint8_t x = (instruction & 0xf00) >> 8u;
+        uint8_t y = (instruction & 0xf0) >> 4u;
+        uint8_t n = instruction & 0xf;
 
-        std::unique_lock lck{m_displayMutex};
-        drw(xyn);
-        lck.unlock();
+        drw<Q>(x, y, n);
 
-        std::this_thread::yield();
+        // waiting for the vertical blank, the thread sleeps at the end of the frame instead
+        if (!m_waitForVBlank)
+        {
+            std::this_thread::yield();
+        }
 
         m_PC = static_cast<Address>(m_PC + 2);
         break;
@@ -432,9 +573,7 @@ void Chip8::execute(const Chip8::Instruction i)
         {
             uint8_t x = (instruction & 0xf00) >> 8u;
 
-            std::unique_lock lck{m_eventMutex};
             skp(x);
-            lck.unlock();
 
             m_PC = static_cast<Address>(m_PC + 2);
             break;
@@ -444,9 +583,7 @@ void Chip8::execute(const Chip8::Instruction i)
         {
             uint8_t x = (instruction & 0xf00) >> 8u;
 
-            std::unique_lock lck{m_eventMutex};
             sknp(x);
-            lck.unlock();
 
             m_PC = static_cast<Address>(m_PC + 2);
             break;
@@ -524,7 +661,7 @@ void Chip8::execute(const Chip8::Instruction i)
         case 0x55:
         {
             uint8_t x = (instruction & 0xf00) >> 8u;
-            ldIVx(x);
+            ldIVx<Q>(x);
             m_PC = static_cast<Address>(m_PC + 2);
             break;
         }
@@ -532,7 +669,7 @@ void Chip8::execute(const Chip8::Instruction i)
         case 0x65:
         {
             uint8_t x = (instruction & 0xf00) >> 8u;
-            ldVxI(x);
+            ldVxI<Q>(x);
             m_PC = static_cast<Address>(m_PC + 2);
             break;
         }
@@ -553,233 +690,97 @@ void Chip8::execute(const Chip8::Instruction i)
 }
 
 
-void Chip8::jp(const uint16_t nnn)
-{
-    m_PC = nnn;
-}
-
-void Chip8::call(const uint16_t nnn)
+void Chip8::cls()
 {
-    ++m_SP;
-    m_stack[m_SP] = m_PC;
-    m_PC = Address(nnn);
+    m_display->clear();
 }
 
-void Chip8::se(const uint16_t xkk)
+void Chip8::jp(const uint16_t nnn)
 {
-    uint8_t x = (xkk & 0xf00) >> 8u; // leftmost 4 bits of xkk
-    uint8_t kk = static_cast<uint8_t>(xkk & 0xff); // rightmost 8 bits of xkk
-    if (m_registers[x] == kk)
-    {
-        m_PC = static_cast<Address>(m_PC + 2);
-    }
+    instructions::jp(Machine {*this}, nnn);
 }
 
-void Chip8::sne(const uint16_t xkk)
+void Chip8::call(const uint16_t nnn)
 {
-    uint8_t x = (xkk & 0xf00) >> 8u; // leftmost 4 bits of xkk
-    uint8_t kk = static_cast<uint8_t>(xkk & 0xff); // rightmost 8 bits of xkk
-    if (m_registers[x] != kk)
-    {
-        m_PC = static_cast<Address>(m_PC + 2);
-    }
+    instructions::call(Machine {*this}, nnn);
 }
 
-void Chip8::se(const uint8_t xy)
+void Chip8::se(const uint8_t x, const uint8_t kk)
 {
-    uint8_t x = (xy & 0xf0) >> 4u;
-    uint8_t y = xy & 0xf;
-    if (m_registers[x] == m_registers[y])
-    {
-        m_PC = static_cast<Address>(m_PC + 2);
-    }
+    instructions::se(Machine {*this}, x, kk);
 }
 
-void Chip8::ld(const uint16_t xkk)
+void Chip8::sne(const uint8_t x, const uint8_t kk)
 {
-    uint8_t x = (xkk & 0xf00) >> 8u;
-    uint8_t kk = static_cast<uint8_t>(xkk & 0xff);
-    m_registers[x] = kk;
+    instructions::sne(Machine {*this}, x, kk);
 }
 
-void Chip8::add(const uint16_t xkk)
+void Chip8::seVxVy(const uint8_t x, const uint8_t y)
 {
-    uint8_t x = (xkk & 0xf00) >> 8u;
-    uint8_t kk = static_cast<uint8_t>(xkk & 0xff);
-    m_registers[x] = static_cast<Register>(m_registers[x] + kk);
+    instructions::seVxVy(Machine {*this}, x, y);
 }
 
-void Chip8::ld(const uint8_t xy)
+void Chip8::ld(const uint8_t x, const uint8_t kk)
 {
-    uint8_t x = (xy & 0xf0) >> 4u;
-    uint8_t y = xy & 0xf;
-    m_registers[x] = m_registers[y];
+    instructions::ld(Machine {*this}, x, kk);
 }
 
-void Chip8::bitOr(const uint8_t xy)
+void Chip8::add(const uint8_t x, const uint8_t kk)
 {
-    uint8_t x = (xy & 0xf0) >> 4u;
-    uint8_t y = xy & 0xf;
-    m_registers[x]= m_registers[x] | m_registers[y];
+    instructions::add(Machine {*this}, x, kk);
 }
 
-void Chip8::bitAnd(const uint8_t xy)
+void Chip8::ldVxVy(const uint8_t x, const uint8_t y)
 {
-    uint8_t x = (xy & 0xf0) >> 4u;
-    uint8_t y = xy & 0xf;
-    m_registers[x] = m_registers[x] & m_registers[y];
+    instructions::ldVxVy(Machine {*this}, x, y);
 }
 
-void Chip8::bitXor(const uint8_t xy)
+void Chip8::bitOr(const uint8_t x, const uint8_t y)
 {
-    uint8_t x = (xy & 0xf0) >> 4u;
-    uint8_t y = xy & 0xf;
-    m_registers[x] = m_registers[x] ^ m_registers[y];
+    instructions::bitOr(Machine {*this}, x, y);
 }
 
-void Chip8::add(const uint8_t xy)
+void Chip8::bitAnd(const uint8_t x, const uint8_t y)
 {
-    uint8_t x = (xy & 0xf0) >> 4u;
-    uint8_t y = xy & 0xf;
-
-    m_registers[x] = static_cast<uint8_t>(m_registers[x] + m_registers[y]);
-
-    if (m_registers[x] < m_registers[y])
-    {
-        m_registers[0xf] = 1;
-    }
-    else
-    {
-        m_registers[0xf] = 0;
-    }
+    instructions::bitAnd(Machine {*this}, x, y);
 }
 
-void Chip8::sub(const uint8_t xy)
+void Chip8::bitXor(const uint8_t x, const uint8_t y)
 {
-    uint8_t x = (xy & 0xf0) >> 4u;
-    uint8_t y = xy & 0xf;
-
-    Register val_x = m_registers[x];
-    Register val_y = m_registers[y];
-
-    m_registers[x] = static_cast<Register>(val_x - val_y);
-
-    if (val_x >= val_y)
-    {
-        m_registers[0xf] = 1;
-    }
-    else
-    {
-        m_registers[0xf] = 0;
-    }
+    instructions::bitXor(Machine {*this}, x, y);
 }
 
-void Chip8::shr(const uint8_t xy)
+void Chip8::addVxVy(const uint8_t x, const uint8_t y)
 {
-    // this instruction differs in chip8 and schip8
-    if (int(m_instructionSet))
-    {
-        uint8_t x = (xy & 0xf0) >> 4u;
-        Register val_x = m_registers[x];
-
-        if ((val_x & 1) == 1)
-        {
-            m_registers[0xf] = 1;
-        }
-        else
-        {
-            m_registers[0xf] = 0;
-        }
-
-        m_registers[x] /= 2;
-    }
-    else
-    {
-        uint8_t x = (xy & 0xf0) >> 4u;
-        uint8_t y = xy & 0xf;
-
-        Register val_y = m_registers[y];
-        m_registers[x] = val_y >> 1u;
-
-        m_registers[0xf] = val_y & 0b1;
-    }
-
+    instructions::addVxVy(Machine {*this}, x, y);
 }
 
-void Chip8::subn(const uint8_t xy)
+void Chip8::sub(const uint8_t x, const uint8_t y)
 {
-    uint8_t x = (xy & 0xf0) >> 4u;
-    uint8_t y = xy & 0xf;
-
-    Register val_x = m_registers[x];
-    Register val_y = m_registers[y];
-
-    m_registers[x] = static_cast<Register>(val_y - val_x);
-
-    if (val_y > val_x)
-    {
-        m_registers[0xf] = 1;
-    }
-    else
-    {
-        m_registers[0xf] = 0;
-    }
+    instructions::sub(Machine {*this}, x, y);
 }
 
-void Chip8::shl(const uint8_t xy)
+void Chip8::subn(const uint8_t x, const uint8_t y)
 {
-    // this instruction differs in chip8 and schip8
-    if (int(m_instructionSet)) // if chip8Type is schip8
-    {
-        uint8_t x = (xy & 0xf0) >> 4u;
-        Register val_x = m_registers[x];
-
-        if ((val_x >> 7u) == 1)
-        {
-            m_registers[0xf] = 1;
-        }
-        else
-        {
-            m_registers[0xf] = 0;
-        }
-
-        m_registers[x] = static_cast<Register>(val_x*2);
-    }
-    else // if chip8Type is chip8
-    {
-        uint8_t x = (xy & 0xf0) >> 4u;
-        uint8_t y = xy & 0xf;
-
-        Register val_y = m_registers[y];
-        m_registers[x] = static_cast<Register>(val_y << 1u);
-
-        m_registers[0xf] = val_y & 0b10000000;
-    }
-
+    instructions::subn(Machine {*this}, x, y);
 }
 
-void Chip8::sne(const uint8_t xy)
+void Chip8::sneVxVy(const uint8_t x, const uint8_t y)
 {
-    uint8_t x = (xy & 0xf0) >> 4u;
-    uint8_t y = xy & 0xf;
-
-    if (m_registers[x] != m_registers[y])
-    {
-        m_PC = static_cast<Address>(m_PC + 2);
-    }
+    instructions::sneVxVy(Machine {*this}, x, y);
 }
 
 void Chip8::ldI(const uint16_t nnn)
 {
-    m_I = nnn;
+    instructions::ldI(Machine {*this}, nnn);
 }
 
 void Chip8::jpV0(const uint16_t nnn)
 {
-    m_PC = static_cast<Address>(m_registers[0] + nnn);
+    instructions::jpV0(Machine {*this}, nnn);
 }
 
-void Chip8::rnd(const uint16_t xkk)
+void Chip8::rnd(const uint8_t x, const uint8_t kk)
 {
     // generator and distribution are static because they are expensive to create
     // and because otherwise they would generate always the same number,
@@ -788,79 +789,54 @@ void Chip8::rnd(const uint16_t xkk)
     static std::uniform_int_distribution<> distribution(0, 255);
     uint8_t randomNumber = static_cast<uint8_t>(distribution(generator));
 
-    uint8_t x = (xkk & 0xf00) >> 8u;
-    uint8_t kk = static_cast<uint8_t>(xkk & 0xff);
-
-    m_registers[x] = randomNumber & kk ;
-}
-
-void Chip8::drw(const uint16_t xyn)
-{
-    uint8_t x = (xyn & 0xf00) >> 8u;
-    uint8_t y = (xyn & 0xf0) >> 4u;
-    uint8_t n = static_cast<uint8_t>(xyn & 0xf); // length of the sprite
-
-    uint8_t coord_x = static_cast<uint8_t>(m_registers[x] % 64);
-    uint8_t coord_y = m_registers[y] % 32;
-
-    std::vector<uint8_t> sprite;
-    for (int i = m_I; i < m_I+n; ++i)
-    {
-        sprite.emplace_back((*m_ramPtr)[i]);
-    }
-
-    bool pixelWasUnset;
-
-    if (m_drawBehaviour == DrawBehaviour::clip)
-    {
-        pixelWasUnset = m_display->drwClip(std::move(sprite), coord_x, coord_y);
-    }
-
-    else
-    {
-        pixelWasUnset = m_display->drwWrap(std::move(sprite), coord_x, coord_y);
-    }
-
-    // the variable sprite is now invalid
-
-    if (pixelWasUnset)
-    {
-        m_registers[0xf] = 1;
-    }
-    else
-    {
-        m_registers[0xf] = 0;
-    }
+    instructions::rnd(Machine {*this}, x, kk, randomNumber);
 }
 
 void Chip8::skp(const uint8_t x)
 {
-    if (m_chip8Keys[m_registers[x]])
-    {
-        m_PC = static_cast<Address>(m_PC + 2);
-    }
+    instructions::skp(Machine {*this}, x);
 }
 
 void Chip8::sknp(const uint8_t x)
 {
-    if (!m_chip8Keys[m_registers[x]])
-    {
-        m_PC = static_cast<Address>(m_PC + 2);
-    }
+    instructions::sknp(Machine {*this}, x);
 }
 
 void Chip8::ldVxDT(const uint8_t x)
 {
-    m_registers[x] = m_delayTimer;
+    m_registers[x] = (m_timerMode == TimerMode::lazy) ? m_lazyDelayTimer.valueAt(currentTick()) : m_delayTimer.load();
 }
 
 void Chip8::ldVxK(const uint8_t x)
 {
-    std::unique_lock eventMutexLock {m_eventMutex};
-    // we wait for the user to either press a valid key or to close the window
-    m_eventHappened.wait(eventMutexLock,
-        [&]{ return (m_lastPressedKey.has_value() || !m_isRunning); }
-        );
+    // with a single thread there is nobody else to wait for: if no key has been pressed,
+    // the program counter goes back so that the instruction is executed again
+    if (m_scheduling == Scheduling::singleThread && m_isRunning)
+    {
+        readKeyEdges();
+
+        if (!m_lastPressedKey.has_value())
+        {
+            m_PC = static_cast<Address>(m_PC - 2);
+            return;
+        }
+    }
+
+    // what has been drawn so far must be shown while waiting
+    m_display->publish(*m_frameBuffer);
+
+    // we wait for the user to either press a valid key or to close the window.
+    // The events are counted before reading the edges, so that none of them can be missed
+    uint32_t events {m_keyboard->getEvents()};
+    readKeyEdges();
+
+    while (!m_lastPressedKey.has_value() && m_isRunning)
+    {
+        m_keyboard->waitForEvent(events);
+
+        events = m_keyboard->getEvents();
+        readKeyEdges();
+    }
 
     if (m_lastPressedKey.has_value())
     {
@@ -871,86 +847,52 @@ void Chip8::ldVxK(const uint8_t x)
     m_lastPressedKey = std::nullopt;
 }
 
+void Chip8::readKeyEdges()
+{
+    for (std::optional<Keyboard::Edge> edge {m_keyboard->pop()}; edge.has_value(); edge = m_keyboard->pop())
+    {
+        // releasing any key forgets the last pressed key, as fx0a waits for a key which is still pressed
+        m_lastPressedKey = edge->m_pressed ? std::optional<Register> {edge->m_key} : std::nullopt;
+    }
+}
+
 void Chip8::ldDTVx(const uint8_t x)
 {
+    if (m_timerMode == TimerMode::lazy)
+    {
+        m_lazyDelayTimer = {m_registers[x], currentTick()};
+        return;
+    }
+
     m_delayTimer = m_registers[x];
     m_setDelayTimer.notify_one();
 }
 
 void Chip8::ldSTVx(const uint8_t x)
 {
+    // the sound starts (or stops) right away, and updateSound stops it when the timer reaches 0
+    if (m_timerMode == TimerMode::lazy)
+    {
+        m_lazySoundTimer = {m_registers[x], currentTick()};
+        updateSound();
+        return;
+    }
+
     m_soundTimer = m_registers[x];
     m_setSoundTimer.notify_one();
 }
 
 void Chip8::addI(const uint8_t x)
 {
-    m_I = static_cast<Address>(m_registers[x] + m_I);
+    instructions::addI(Machine {*this}, x);
 }
 
 void Chip8::ldFVx(const uint8_t x)
 {
-    Register val_x = m_registers[x];
-
-    m_I = static_cast<uint16_t>(val_x * 5);
+    instructions::ldFVx(Machine {*this}, x);
 }
 
 void Chip8::ldB(const uint8_t x)
 {
-    Register val_x = m_registers[x];
-    (*m_ramPtr)[m_I] = static_cast<uint8_t>(val_x / 100);
-
-    val_x = static_cast<uint8_t>(val_x - (*m_ramPtr)[m_I] * 100);
-    (*m_ramPtr)[m_I+1] = static_cast<uint8_t>(val_x / 10);
-
-    val_x = static_cast<uint8_t>(val_x - (*m_ramPtr)[m_I+1] * 10);
-    (*m_ramPtr)[m_I+2] = static_cast<uint8_t>(val_x);
-}
-
-void Chip8::ldIVx(const uint8_t x)
-{
-    // this instruction differs in chip8 and schip8
-    if (int(m_instructionSet)) // if chip8Type is schip8
-    {
-        uint16_t J = m_I;
-        for (int i : std::ranges::iota_view(0, x+1))
-        {
-            (*m_ramPtr)[J] = m_registers[i];
-            ++J;
-        }
-    }
-    else // if chip8Type is chip8
-    {
-        for (int i : std::ranges::iota_view(0, x+1))
-        {
-            (*m_ramPtr)[m_I] = m_registers[i];
-            ++m_I;
-        }
-    }
-
-}
-
-void Chip8::ldVxI(const uint8_t x)
-{
-    // this instruction differs in chip8 and schip8
-    if (int(m_instructionSet)) // if chip8Type is schip8
-    {
-        uint16_t J = m_I;
-
-        for (int i : std::ranges::iota_view(0, x+1))
-        {
-            m_registers[i] = (*m_ramPtr)[J];
-            ++J;
-        }
-    }
-    else // if chip8Type is chip8
-    {
-        for (int i : std::ranges::iota_view(0, x+1))
-        {
-            m_registers[i] = (*m_ramPtr)[m_I];
-            ++m_I;
-        }
-    }
-
+    instructions::ldB(Machine {*this}, x);
 }
-
@@ -1,12 +1,16 @@
 #pragma once
 
+#include "instructions.h"
+#include <algorithm>
 #include <array>
+#include <bitset>
 #include <filesystem>
 #include <mutex>
 #include <future>
 #include <condition_variable>
 #include <thread>
 #include <optional>
+#include <span>
 #include <vector>
 
 /*
@@ -32,6 +36,30 @@ private:
     // when starting the program
     enum class DrawBehaviour {clip, wrap};
 
+    // the settings above never change during a run, so the instructions depending on them
+    // are templates on the quirks: every combination of quirks has its own version of execute
+    // and its own dispatch table, and the right one is selected once when the Chip8 is constructed
+    struct Quirks {
+        InstructionSet m_instructionSet;
+        DrawBehaviour m_drawBehaviour;
+
+        bool operator==(const Quirks&) const = default;
+    };
+
+    // all the combinations of quirks for which the instructions are compiled:
+    // a new quirk only needs a new member in Quirks and its combinations here
+    static constexpr std::array<Quirks, 4> ALL_QUIRKS {{
+        {InstructionSet::chip8, DrawBehaviour::clip},
+        {InstructionSet::chip8, DrawBehaviour::wrap},
+        {InstructionSet::schip8, DrawBehaviour::clip},
+        {InstructionSet::schip8, DrawBehaviour::wrap}
+    }};
+
+    // calls f.template operator()<Q>() with the combination Q of ALL_QUIRKS equal to quirks
+    // and returns its result
+    template <typename F>
+    static auto withQuirks(const Quirks quirks, F&& f);
+
     using Register = uint8_t;
 
     using Address = uint16_t;
@@ -45,7 +73,50 @@ private:
         uint16_t m_inst;
     };
 
-    // array of the hexadecimal sprites to be copied in m_ramPtr
+    // the version of execute for the quirks of the Chip8
+    using ExecuteFunction = void (Chip8::*)(const Instruction);
+
+    struct DecodedInstruction;
+
+    // function executing an instruction that has already been decoded
+    using Handler = void (*)(Chip8&, const DecodedInstruction&);
+
+    // an instruction already split into the function that executes it and its operands,
+    // so that it doesn't need to be decoded again every time it is executed
+    struct DecodedInstruction {
+        Handler m_handler;
+        uint16_t m_nnn;
+        uint8_t m_x;
+        uint8_t m_y;
+        uint8_t m_kk;
+        uint8_t m_n;
+    };
+
+    // one decoded instruction for each of the 65536 possible instructions
+    using DispatchTable = std::array<DecodedInstruction, 65536>;
+
+    // collection of the handlers of the decoded instructions (look at dispatch.cpp)
+    struct Dispatch;
+
+    // gives the instructions of instructions.h access to the registers, the ram, the keyboard and the display
+    struct Machine;
+
+public:
+    struct Pixel;
+    class Display;
+    class FrameBuffer;
+    class FadingPlane;
+    class Keyboard;
+    class BlockCache;
+    class Jit;
+    class RecompiledCode;
+    class Fusions;
+
+    // gives the sources generated by chip8_recompiler access to the registers and to the interpreter
+    // (look at recompiled.h)
+    struct RecompiledAccess;
+
+    // array of the hexadecimal sprites to be copied in m_ramPtr (it is used by Chip8Lite as well)
     inline constexpr static std::array<std::array<uint8_t, 5>, 16> m_hexadecimalSprites {{
         { 0xf0, 0x90, 0x90, 0x90, 0xf0 },
         { 0x20, 0x60, 0x20, 0x20, 0x70 },
@@ -65,10 +136,6 @@ private:
         { 0xf0, 0x80, 0xf0, 0x80, 0x80 }
      }};
 
-public:
-    struct Pixel;
-    class Display;
-
     enum class Status {off, on};
     enum class Fading {on, off};
 
@@ -77,20 +144,16 @@ public:
     Fading m_fadingFlag; // flag saying whether we want to enable the fading effect or not
 
     std::unique_ptr<Display> m_display {};
-    mutable std::mutex m_displayMutex {};
 
-    // every uint8_t corresponds to a key:
-    // false = not pressed
-    // true = pressed
-    std::array<std::atomic<bool>, 16> m_chip8Keys {};
+    // the frames of m_display published for the render thread, which reads them without locking
+    std::unique_ptr<FrameBuffer> m_frameBuffer {};
 
-    // key used for instruction ldVxK
-    std::optional<Register> m_lastPressedKey {};
+    // the keys pressed and released by the user, which the emulation thread reads without locking
+    std::unique_ptr<Keyboard> m_keyboard {};
 
-    // this mutex protects m_chip8PressedKey and m_isRunning
-    std::mutex m_eventMutex {};
-    // locks the m_eventMutex and checks that a key has been pressed or that m_isRunning is false
-    std::condition_variable m_eventHappened {};
+    // key used for instruction ldVxK: the last key pressed and not released yet.
+    // It is computed by readKeyEdges and only used by the emulation thread
+    std::optional<Register> m_lastPressedKey {};
 
     std::mutex m_delayTimerMutex {};
     std::condition_variable m_setDelayTimer {}; // checks if the delay timer is non zero or chip8 is not running anymore
@@ -101,9 +164,11 @@ public:
     std::function<void()> m_pauseSoundCallback; // callback function to pause sound
 
 private:
-    // specifies the settings with which we want to run the program
-    InstructionSet m_instructionSet; // set of instructions
-    DrawBehaviour m_drawBehaviour; // drawing sprites using clipping or wrapping
+    // specifies the settings with which we want to run the program:
+    // the set of instructions and whether the sprites are drawn using clipping or wrapping
+    Quirks m_quirks;
+
+    ExecuteFunction m_execute; // execute<m_quirks>, selected by the constructor
 
     std::unique_ptr<std::array<Register, 4096>> m_ramPtr =
     std::make_unique<std::array< Register, 4096>>();
@@ -116,10 +181,35 @@ private:
     std::condition_variable m_hasStartedRunning {}; // checks if m_isRunning is true
 
     std::atomic<Register> m_delayTimer {};
-    std::jthread m_delayTimerThread {[this] { this->Chip8::decreaseDelayTimer(); }};
+    std::jthread m_delayTimerThread {}; // spawned by run
 
     std::atomic<Register> m_soundTimer {};
-    std::jthread m_soundTimerThread {[this] { this->Chip8::decreaseSoundTimer(); }};
+    std::jthread m_soundTimerThread {}; // spawned by run
+
+    // a timer in TimerMode::lazy: its value was m_value at the tick m_setAt
+    // and it decreases by one at every tick until it reaches 0
+    struct LazyTimer {
+        Register m_value {};
+        uint64_t m_setAt {};
+
+        Register valueAt(const uint64_t tick) const
+        {
+            const uint64_t elapsed {tick - m_setAt};
+            return (elapsed >= m_value) ? Register {0} : static_cast<Register>(m_value - elapsed);
+        }
+    };
+
+    LazyTimer m_lazyDelayTimer {};
+    LazyTimer m_lazySoundTimer {};
+
+    // the ticks of the timers counted by tickTimers, which measure the emulated time
+    // unless run is executing the rom in real time
+    uint64_t m_ticks {0};
+
+    // while run executes the rom, the ticks are measured by the clock instead: m_startTime is when
+    // the tick 0 would have started, so that the ticks go on from m_ticks, where run writes them back when it returns
+    bool m_isRealTime {false};
+    std::chrono::steady_clock::time_point m_startTime {};
 
     Address m_PC; // program counter
 
@@ -143,20 +233,350 @@ public:
     // runs the program that has been copied in ram
     void run(std::future<bool>&& futureDisplayInitialized);
 
+    // frequency of the internal clock of the chip8 and of its timers
+    static constexpr uint64_t CLOCK_FREQUENCY {500};
+    static constexpr uint64_t TIMER_FREQUENCY {60};
+
+    // the emulated time between two ticks of the timers
+    static constexpr std::chrono::nanoseconds FRAME_PERIOD {std::chrono::nanoseconds {std::chrono::seconds {1}} / TIMER_FREQUENCY};
+
+    // how the instructions and the timers are scheduled:
+    // - threads: run executes the instructions in its own thread, while the timers are decreased
+    //   by two more threads, so the values read by the rom depend on how the os schedules them;
+    // - singleThread: the caller executes the frames of emulated time with runFrames, which also ticks
+    //   the timers, so the execution only depends on the rom, on the keys pressed and on the numbers drawn by cxkk.
+    //   fx0a never blocks the caller: it is executed again until a key is pressed
+    enum class Scheduling {threads, singleThread};
+
+    // how the delay and sound timers are kept:
+    // - lazy: a timer is stored as the value it was set to and the tick when it was set,
+    //   so nothing happens at the ticks and its current value is only computed when fx07 reads it;
+    // - threads: the timers are decreased at every tick, by their own threads when run executes the rom
+    //   (look at decreaseTimer) and by tickTimers otherwise. It is the original behaviour, kept for comparison
+    enum class TimerMode {lazy, threads};
+
+    // it must be chosen before the rom starts running
+    TimerMode m_timerMode {TimerMode::lazy};
+
+    // how the number of instructions executed by run and runFrames in every frame of 1/60 s is chosen:
+    // - instructionsPerFrame: m_amount instructions in every frame (the "cycles per frame" of many roms' documentation);
+    // - instructionsPerSecond: m_amount instructions every second, spread over the frames as evenly as possible;
+    // - uncapped: as many instructions as the host can execute, m_amount is ignored.
+    //   The timers keep ticking 60 times per second and the display is still published at the end of every frame.
+    //   runFrames and runTurbo don't follow the clock, so they execute a fixed number of instructions per frame instead
+    enum class SpeedUnit {instructionsPerFrame, instructionsPerSecond, uncapped};
+
+    struct Speed {
+        SpeedUnit m_unit;
+        uint64_t m_amount;
+    };
+
+    // it must be chosen before the rom starts running
+    Speed m_speed {SpeedUnit::instructionsPerSecond, CLOCK_FREQUENCY};
+
+    // many roms wait for the delay timer with the loop Fx07, 3xkk, 1nnn jumping back to Fx07,
+    // which can't end before the next tick of the timers: when the rom is in such a loop,
+    // the instructions left before the next tick are skipped, leaving the chip8 in the same state
+    // as if they had been executed (look at idle.cpp). Only with TimerMode::lazy
+    bool m_skipIdleLoops {true};
+
+    // the chip8 of the COSMAC VIP waited for the vertical blank of the screen before drawing a sprite:
+    // with m_waitForVBlank, dxyn waits for the next tick of the timers (60 per second) before drawing,
+    // so that at most one sprite is drawn per frame and the roms drawing a lot run at their original speed.
+    // In the meantime dxyn is executed again and again without doing anything, as fx0a with Scheduling::singleThread,
+    // and when m_skipIdleLoops is true these executions are skipped as an idle loop (so run sleeps until the tick).
+    // It must be chosen before the rom starts running
+    bool m_waitForVBlank {false};
+
+    struct IdleStatistics {
+        uint64_t m_idleLoops; // times the chip8 has been found waiting in an idle loop
+        uint64_t m_skippedInstructions; // instructions of the idle loops that have not been executed
+    };
+
+    IdleStatistics getIdleStatistics() const { return m_idleStatistics; }
+
+    // run sleeps until the end of every frame; the last m_spinDuration before the end are spent
+    // spinning instead, which is more precise than the wake up of the os but keeps a core busy
+    std::chrono::nanoseconds m_spinDuration {0};
+
+    struct PacingStatistics {
+        uint64_t m_frames; // number of frames executed by run
+        uint64_t m_instructions; // number of instructions executed by run
+        uint64_t m_missedDeadlines; // number of frames whose instructions ended after the end of the frame
+        std::chrono::nanoseconds m_maximalLateness; // the latest wake up after the end of a frame
+        double m_instructionsPerSecond; // instructions executed per second of real time
+    };
+
+    // the statistics of the last call to run, which must have returned
+    PacingStatistics getPacingStatistics() const { return m_pacingStatistics; }
+
+    // executes numFrames frames of 1/60 s of emulated time in the calling thread, back to back:
+    // every frame is made of the instructions given by m_speed followed by a tick of the timers
+    // (UNCAPPED_FRAME instructions with SpeedUnit::uncapped, so that the execution stays deterministic).
+    // The display is published to the frame buffer at the end, and the Chip8 switches to Scheduling::singleThread.
+    // Running the frames faster or slower than real time is up to the caller
+    void runFrames(const uint64_t numFrames);
+
+    // the budget of runTurbo can be given either in instructions or in frames of 1/60 s of emulated time
+    enum class Budget {instructions, frames};
+
+    struct TurboStatistics {
+        uint64_t m_instructions; // number of instructions executed
+        uint64_t m_frames; // number of timer ticks (1/60 s of emulated time) elapsed
+        double m_seconds; // host time spent executing
+        double m_instructionsPerSecond;
+    };
+
+    // runs the program that has been copied in ram as fast as the host allows:
+    // there is no display to wait for and no sleep between the instructions.
+    // The timers are ticked directly by this thread, once every 1/60 s of emulated time
+    // (after the instructions of a frame as given by m_speed, like runFrames),
+    // and the execution stops when the budget is over.
+    // m_isRunning stays false, so the instruction fx0a doesn't wait for a key.
+    TurboStatistics runTurbo(const Budget unit, const uint64_t amount);
+
+    // The state of the chip8 saved by saveState and restored by loadState, which is also its binary format:
+    // the struct has no padding, so its bytes can be written to a file or sent to another process as they are.
+    // The numbers are in the byte order of the host, so m_magic can't be read by a host with the other byte order.
+    // A new version is needed every time the struct changes
+    struct State {
+        uint32_t m_magic;
+        uint32_t m_version;
+        uint64_t m_ticks; // the ticks of the timers in emulated time (look at tickTimers)
+        uint64_t m_vblankTick; // look at m_waitForVBlank
+        uint64_t m_frameInstructionsLeft; // the instructions of the current frame not executed yet (look at runTurbo)
+        std::array<uint64_t, 32> m_display; // the rows of the display
+        std::array<Register, 4096> m_ram;
+        std::array<Address, 16> m_stack;
+        Address m_I;
+        Address m_PC;
+        uint16_t m_pressedKeys; // bit k is set if the key k is pressed
+        std::array<Register, 16> m_registers;
+        uint8_t m_SP;
+        Register m_delayTimer;
+        Register m_soundTimer;
+        uint8_t m_lastPressedKey; // NO_KEY if no key has been pressed
+        uint8_t m_instructionSet;
+        uint8_t m_drawBehaviour;
+        uint8_t m_speedRemainder; // the instructions owed to the next frames (look at m_speed)
+        std::array<uint8_t, 3> m_reserved; // zero
+    };
+
+    static constexpr uint32_t STATE_MAGIC {0x38504843}; // "CHP8" in little endian
+    static constexpr uint32_t STATE_VERSION {2};
+    static constexpr uint8_t NO_KEY {0xff};
+
+    // copies the state of the chip8, which must not be running (in run or in another thread).
+    // The random numbers of cxkk are not part of the state
+    State saveState() const;
+
+    // what loadState did with the state: only loaded restored it, the others tell why it has been rejected
+    // - wrongSize: the bytes are not as many as sizeof(State);
+    // - wrongVersion: the state has not been saved by this version of the emulator (m_magic or m_version);
+    // - wrongSettings: the state has been saved with other quirks (the flags -s and -w);
+    // - invalidState: the stack pointer, the program counter, a return address or I point outside of the stack
+    //   or of the ram, so the state is corrupted (saveState never writes such a state)
+    enum class LoadStateResult {loaded, wrongSize, wrongVersion, wrongSettings, invalidState};
+
+    // restores a state saved by saveState, if it has the same version and the same quirks as this chip8.
+    // The chip8 must not be running; the engine stays the same. Nothing is printed, the caller reports the result
+    LoadStateResult loadState(const State& state);
+
+    // same as above for a state that has been stored as bytes
+    LoadStateResult loadState(std::span<const std::byte> bytes);
+
+    // the engines that can execute the instructions of the rom:
+    // - switchCase decodes every instruction it executes through the switch in execute;
+    // - dispatchTable looks every instruction up in a table where all the 65536 possible instructions
+    //   have been decoded once, so that executing an instruction is just an indirect call;
+    // - blockCache keeps the straight-line runs of instructions it executes already decoded,
+    //   so that the instructions of a block are neither fetched nor decoded again;
+    // - jit translates the blocks that are executed often into native x86-64 code
+    //   and executes the other instructions through the dispatch table.
+    //   It is only available if the library has been built with the option CHIP8_JIT on x86-64 Linux,
+    //   otherwise it behaves as dispatchTable;
+    // - recompiled runs the blocks of the rom that have been translated into C++ ahead of time
+    //   by chip8_recompiler and linked in the program, and executes the other instructions
+    //   through the dispatch table. If no recompiled program matches the rom (or m_waitForVBlank is true), it behaves as dispatchTable;
+    // - threaded executes the same instructions as switchCase, but jumps from the end of every instruction
+    //   directly to the code of the next one (computed goto). It is only available if the library has been
+    //   built with the option CHIP8_THREADED by GCC or Clang, otherwise it behaves as switchCase;
+    // - fused looks for common pairs and triples of instructions in the rom when it is read
+    //   (6xkk followed by Fx15, Fx07 followed by 3xkk and 1nnn, Annn followed by Dxyn) and executes each of them
+    //   as a single instruction; all the other instructions are executed through the dispatch table.
+    // The default engine is switchCase
+    enum class Engine {switchCase, dispatchTable, blockCache, jit, recompiled, threaded, fused};
+
+    void setEngine(const Engine engine);
+
+    struct BlockCacheStatistics {
+        uint64_t m_hits; // blocks found in the cache
+        uint64_t m_misses; // blocks that had to be decoded
+        uint64_t m_invalidations; // blocks discarded because the program wrote over them
+    };
+
+    // the statistics are all zero if the engine blockCache has never been selected
+    BlockCacheStatistics getBlockCacheStatistics() const;
+
+    struct JitStatistics {
+        uint64_t m_compiledBlocks; // blocks translated into native code
+        uint64_t m_nativeInstructions; // instructions executed by the native code
+        uint64_t m_interpretedInstructions; // instructions executed through the dispatch table
+        uint64_t m_invalidations; // compiled blocks discarded because the program wrote over them
+        uint64_t m_flushes; // times all the compiled blocks were discarded because the code buffer was full
+    };
+
+    // the statistics are all zero if the engine jit has never been selected
+    JitStatistics getJitStatistics() const;
+
+    // a block of the rom translated into C++ by chip8_recompiler: the function executes the first n
+    // instructions of the block (at least one and at most m_length) and returns the new program counter
+    using RecompiledFunction = uint16_t (*)(Chip8&, uint32_t);
+
+    struct RecompiledBlock {
+        uint16_t m_address;
+        uint8_t m_length;
+        RecompiledFunction m_function;
+    };
+
+    // a rom and its recompiled blocks, as emitted by chip8_recompiler
+    struct RecompiledProgram {
+        std::span<const uint8_t> m_rom;
+        std::span<const RecompiledBlock> m_blocks;
+    };
+
+    // makes the program available to the engine recompiled, which uses it if the rom in ram is m_rom.
+    // The sources generated by chip8_recompiler call it during their static initialization,
+    // so the program must have static storage duration. Always returns true
+    static bool registerRecompiledProgram(const RecompiledProgram& program);
+
+    struct RecompiledStatistics {
+        uint64_t m_blocks; // recompiled blocks available for the rom in ram
+        uint64_t m_nativeInstructions; // instructions executed by the recompiled blocks
+        uint64_t m_interpretedInstructions; // instructions executed through the dispatch table
+        uint64_t m_invalidations; // recompiled blocks discarded because the program wrote over them
+    };
+
+    // the statistics are all zero if the engine recompiled has never been selected
+    RecompiledStatistics getRecompiledStatistics() const;
+
+    struct FusionCounters {
+        uint64_t m_found; // occurrences in ram when the rom was read
+        uint64_t m_fired; // times they have been executed as a single instruction
+    };
+
+    struct FusionStatistics {
+        FusionCounters m_loadDelayTimer; // 6xkk followed by Fx15
+        FusionCounters m_waitDelayTimer; // Fx07 followed by 3xkk and 1nnn
+        FusionCounters m_loadIAndDraw; // Annn followed by Dxyn
+        uint64_t m_fusedInstructions; // instructions executed by the fusions
+        uint64_t m_interpretedInstructions; // instructions executed through the dispatch table
+        uint64_t m_invalidations; // fusions discarded because the program wrote over them
+    };
+
+    // the statistics are all zero if the engine fused has never been selected
+    FusionStatistics getFusionStatistics() const;
+
 private:
+    Engine m_engine {Engine::switchCase};
+
+    Scheduling m_scheduling {Scheduling::threads};
+
+    // true while the sound is played because of a tick of the timers by this thread (look at tickTimers)
+    bool m_isPlayingSound {false};
+
+    // table for m_quirks used by all the engines but switchCase, built the first time one of them is selected
+    const DispatchTable* m_dispatchTable {nullptr};
+
+    // used by the engine blockCache, created the first time that engine is selected
+    std::unique_ptr<BlockCache> m_blockCache {};
+
+    // used by the engine jit, created the first time that engine is selected
+    std::unique_ptr<Jit> m_jit {};
+
+    // used by the engine recompiled, created the first time that engine is selected
+    std::unique_ptr<RecompiledCode> m_recompiledCode {};
+
+    // used by the engine fused, created the first time that engine is selected
+    std::unique_ptr<Fusions> m_fusions {};
+
+    // fetches the instruction pointed by m_PC and executes it
+    void step();
+
+    // executes count instructions with the selected engine
+    void executeInstructions(const uint64_t count);
+
+    // executes count instructions using the blocks in m_blockCache
+    void runBlocks(uint64_t count);
+
+    // decodes the block starting at address pc and stores it in m_blockCache;
+    // returns the length of the block
+    uint8_t buildBlock(const Address pc);
+
+    // executes count instructions, running the compiled blocks of m_jit when possible
+    void runJit(uint64_t count);
+
+    // executes count instructions, running the recompiled blocks of m_recompiledCode when possible
+    void runRecompiled(uint64_t count);
+
+    // executes count instructions, running the fusions of m_fusions when possible
+    void runFused(uint64_t count);
+
+    // looks for the fusions in the whole ram and stores them in m_fusions;
+    // it is called when the engine fused is selected and when a rom is read
+    void fuseInstructions();
+
+    // executes count instructions jumping from one instruction to the next through their labels
+    template <Quirks Q>
+    void runThreaded(uint64_t count);
+
+    // the version of runThreaded for the quirks of the Chip8
+    using RunFunction = void (Chip8::*)(uint64_t);
+
+    // runThreaded<m_quirks>, selected when the engine threaded is selected
+    RunFunction m_runThreaded {nullptr};
+
+    // sets m_runThreaded
+    void selectThreaded();
+
+    // looks for a registered recompiled program whose rom is the one in ram and fills m_recompiledCode
+    // with its blocks; it is called when the engine recompiled is selected and when a rom is read
+    void attachRecompiledProgram();
+
+    // the programs registered by registerRecompiledProgram
+    static std::vector<const RecompiledProgram*>& recompiledPrograms();
+
+    // it must be called every time the program writes in ram between the addresses first and last
+    // (included), so that the decoded and compiled instructions that have been overwritten are discarded
+    void ramWritten(const Address first, const Address last);
+
+    // tells if the decoded instruction must be the last one of its block: this is the case
+    // for the instructions that can move the program counter somewhere else than the next instruction
+    // and for the instructions writing in ram
+    bool endsBlock(const DecodedInstruction& decoded) const;
+
     void decreaseDelayTimer() { decreaseTimer(m_delayTimer, 0); }
 
     void decreaseSoundTimer() { decreaseTimer(m_soundTimer, 1); }
 
+    template <Quirks Q>
     void execute(const Instruction i);
 
+    // returns the table of all the instructions decoded for the quirks Q, building it the first time it is called
+    template <Quirks Q>
+    static const DispatchTable& dispatchTable();
+
+    // decodes the instruction in the same way the switch in execute<Q> does
+    template <Quirks Q>
+    static DecodedInstruction decode(const Instruction i);
+
     void decreaseTimer(std::atomic<Register>& timer, bool flagSound);
 
     // instruction 00e0
-    void cls() { m_display = std::make_unique<Display>(m_fadingFlag); }
+    void cls();
 
     // instruction 00ee
-    void ret() { m_PC = m_stack[m_SP]; --m_SP; }
+    void ret();
 
     // instrucion 1nnn
     void jp(const uint16_t nnn);
@@ -165,49 +585,51 @@ private:
     void call(const uint16_t nnn);
 
     // instruction 3xkk
-    void se(const uint16_t xkk);
+    void se(const uint8_t x, const uint8_t kk);
 
     // instruction 4xkk
-    void sne(const uint16_t xkk);
+    void sne(const uint8_t x, const uint8_t kk);
 
     // instruction 5xy0
-    void se(const uint8_t xy);
+    void seVxVy(const uint8_t x, const uint8_t y);
 
     // instruction 6xkk
-    void ld(const uint16_t xkk);
+    void ld(const uint8_t x, const uint8_t kk);
 
     // instruction 7xkk
-    void add(const uint16_t xkk);
+    void add(const uint8_t x, const uint8_t kk);
 
     // instruction 8xy0
-    void ld(const uint8_t xy);
+    void ldVxVy(const uint8_t x, const uint8_t y);
 
     // instruction 8xy1
-    void bitOr(const uint8_t xy);
+    void bitOr(const uint8_t x, const uint8_t y);
 
     // instruction 8xy2
-    void bitAnd(const uint8_t xy);
+    void bitAnd(const uint8_t x, const uint8_t y);
 
     // instruction 8xy3
-    void bitXor(const uint8_t xy);
+    void bitXor(const uint8_t x, const uint8_t y);
 
     // instruction 8xy4
-    void add(const uint8_t xy);
+    void addVxVy(const uint8_t x, const uint8_t y);
 
     // instruction 8xy5
-    void sub(const uint8_t xy);
+    void sub(const uint8_t x, const uint8_t y);
 
     // instruction 8xy6
-    void shr(const uint8_t xy);
+    template <Quirks Q>
+    void shr(const uint8_t x, const uint8_t y);
 
     // instruction 8xy7
-    void subn(const uint8_t xy);
+    void subn(const uint8_t x, const uint8_t y);
 
     // instruction 8xye
-    void shl(const uint8_t xy);
+    template <Quirks Q>
+    void shl(const uint8_t x, const uint8_t y);
 
     // instruction 9xy0
-    void sne(const uint8_t xy);
+    void sneVxVy(const uint8_t x, const uint8_t y);
 
     // instruction annn
     void ldI(const uint16_t nnn);
@@ -216,10 +638,11 @@ private:
     void jpV0(const uint16_t nnm);
 
     // instruction cxkk
-    void rnd(const uint16_t xkk);
+    void rnd(const uint8_t x, const uint8_t kk);
 
     // instruction dxyn
-    void drw(const uint16_t xyn);
+    template <Quirks Q>
+    void drw(const uint8_t x, const uint8_t y, const uint8_t n);
 
     // instruction ex9e
     void skp(const uint8_t x);
@@ -233,6 +656,79 @@ private:
     // instruction fx0a
     void ldVxK(const uint8_t x);
 
+    // updates m_lastPressedKey with the keys pressed and released since the last call
+    void readKeyEdges();
+
+    // a tick of the timers when they are not decreased by their own threads:
+    // in TimerMode::lazy it only counts the tick, otherwise it decreases the timers by one
+    // (if they are not zero). In both cases it starts or stops the sound
+    void tickTimers();
+
+    // the ticks of the timers elapsed so far, measured by the clock while run executes the rom
+    // and counted by tickTimers otherwise (look at m_ticks and m_isRealTime)
+    uint64_t currentTick() const;
+
+    // plays or pauses the sound, depending on the sound timer of TimerMode::lazy
+    void updateSound();
+
+    // if the execution is more than MAXIMAL_LATENESS late, run starts again from the current time
+    // instead of executing all the frames missed at once (for example after fx0a waited for a key)
+    static constexpr std::chrono::nanoseconds MAXIMAL_LATENESS {FRAME_PERIOD * 6};
+
+    PacingStatistics m_pacingStatistics {};
+
+    // with SpeedUnit::instructionsPerSecond, the instructions owed to the next frames in units of 1/TIMER_FREQUENCY,
+    // so that CLOCK_FREQUENCY instructions per second are 8 or 9 per frame, 500 every 60 frames
+    uint64_t m_speedRemainder {0};
+
+    // the instructions of the current frame which have not been executed yet, so that runTurbo can stop
+    // in the middle of a frame and the next call (or runFrames, or run) finishes it before ticking the timers.
+    // It is 0 once the timers have ticked at the end of the frame
+    uint64_t m_frameInstructionsLeft {0};
+
+    // with SpeedUnit::uncapped, run executes the instructions in batches of UNCAPPED_BATCH between two reads of the clock,
+    // while runFrames and runTurbo (which don't follow the clock) execute UNCAPPED_FRAME instructions in every frame
+    static constexpr uint64_t UNCAPPED_BATCH {1000};
+    static constexpr uint64_t UNCAPPED_FRAME {100'000};
+
+    // the number of instructions of the next frame as given by m_speed (without reading the clock)
+    uint64_t instructionsInNextFrame();
+
+    // executes the instructions left in the current frame (all the instructions of the next frame
+    // if the timers have just ticked) and returns how many they were. The caller then ticks the timers
+    uint64_t finishFrame();
+
+    // executes the instructions of a frame of run as given by m_speed and returns how many they were.
+    // With SpeedUnit::uncapped it executes them until frameEnd
+    uint64_t executeFrame(const std::chrono::steady_clock::time_point frameEnd);
+
+    // the loop Fx07, 3xkk, 1nnn starting at m_start, where the instruction 1nnn jumps back to m_start.
+    // The program counter points to the instruction m_position of the loop (0 for Fx07)
+    struct IdleLoop {
+        Address m_start;
+        uint8_t m_x;
+        uint64_t m_position;
+    };
+
+    // the idle loop the program counter is in, if the loop can't end before the next tick of the timers
+    std::optional<IdleLoop> findIdleLoop() const;
+
+    // if the chip8 is in an idle loop, it skips the count instructions which would have been executed
+    // before the next tick and returns true
+    bool skipIdleLoop(const uint64_t count);
+
+    IdleStatistics m_idleStatistics {};
+
+    // with m_waitForVBlank, the tick at which the dxyn waiting for the vertical blank can draw (0 if none is waiting)
+    uint64_t m_vblankTick {0};
+
+    // with m_waitForVBlank, called by dxyn before drawing: returns false (and starts waiting, the first time)
+    // until the next tick of the timers
+    bool reachedVBlank();
+
+    // used by run to wait for the end of the frame ending at deadline (look at pacing.cpp)
+    void waitForDeadline(std::chrono::steady_clock::time_point& deadline);
+
     // instruction fx15
     void ldDTVx(const uint8_t x);
 
@@ -249,9 +745,11 @@ private:
     void ldB(const uint8_t x);
 
     // instruction fx55
+    template <Quirks Q>
     void ldIVx(const uint8_t x);
 
     // instruction fx65
+    template <Quirks Q>
     void ldVxI(const uint8_t x);
 };
 
@@ -268,13 +766,6 @@ public:
 
     constexpr Pixel() : m_status {Status::off}, m_fadingLevel {0} {}
     Pixel(Status s, int32_t fadinglev) : m_status {s}, m_fadingLevel {fadinglev} {}
-
-private:
-    // xor between pixel and status where status = off = 0 or on = 1
-    // keeps the same fading level
-    Chip8::Pixel operator^(Status s);
-
-    friend Chip8::Display;
 };
 
 class Chip8::Display {
@@ -283,36 +774,439 @@ public:
     static constexpr int DISPLAY_HEIGHT {32};
     static constexpr int MAXIMAL_FADING_VALUE {500};
 
+    // a row of the display, where the most significant bit is the column 0
+    using Row = uint64_t;
+
+private:
+    // the whole display takes 256 bytes, so that drawing a sprite row is a single shift and xor
+    std::array<Row, DISPLAY_HEIGHT> m_frame {};
+
+    // the pixels turned off since the last frame published and read by the render thread,
+    // which makes them fade (look at FadingPlane)
+    std::array<Row, DISPLAY_HEIGHT> m_turnedOff {};
+
+    // true if the display has been cleared since the last frame published and read by the render thread
+    bool m_cleared {false};
+
+    // incremented every time the display changes, so that the render thread can skip the frames
+    // which are equal to the one it has already shown
+    uint32_t m_generation {0};
+
+    // xors the sprite row with the row of the display;
+    // returns true if it turned off any pixel
+    bool xorRow(const int row, const Row spriteRow);
+
+public:
+    // turns all the pixels off, without any fading
+    void clear()
+    {
+        m_frame = {};
+        m_turnedOff = {};
+        m_cleared = true;
+        ++m_generation;
+    }
+
+    // does xor of the sprite with the pixels starting at coordinate (x,y)
+    // returns true if this causes any pixel to be unset and false otherwise
+    // clips the pixels over the end of the screen
+    bool drwClip(const std::span<const uint8_t> sprite, const uint8_t x, const uint8_t y);
+
+    // does xor of the sprite with the pixels starting at coordinate (x,y)
+    // returns true if this causes any pixel to be unset and false otherwise
+    // wraps the pixels over the end of the screen
+    bool drwWrap(const std::span<const uint8_t> sprite, const uint8_t x, const uint8_t y);
+
+    // copies the display in the frame buffer and publishes it to the render thread
+    void publish(FrameBuffer& frameBuffer);
+
+    const std::array<Row, DISPLAY_HEIGHT>& getDisplayFrame() const
+    {
+        return m_frame;
+    }
+
+    // replaces all the pixels (used by loadState): the render thread gets them as if the display
+    // had been cleared and drawn again, so the pixels turned off don't fade
+    void setDisplayFrame(const std::array<Row, DISPLAY_HEIGHT>& frame)
+    {
+        m_frame = frame;
+        m_turnedOff = {};
+        m_cleared = true;
+        ++m_generation;
+    }
+};
+
+// Triple buffer passing the frames from the emulation thread to the render thread without locks.
+// Each thread owns one of the three frames (the emulation thread writes the back one,
+// the render thread reads the front one) and the third one is the last published frame.
+// Publishing and reading a frame are a single atomic exchange with the published one,
+// so neither thread ever waits for the other and the render thread always reads a complete frame.
+class Chip8::FrameBuffer {
+public:
+    struct Frame {
+        std::array<Display::Row, Display::DISPLAY_HEIGHT> m_pixels;
+        std::array<Display::Row, Display::DISPLAY_HEIGHT> m_turnedOff; // pixels turned off since the previous frame
+        bool m_cleared; // the display has been cleared since the previous frame
+        uint32_t m_generation; // the generation of the display when the frame was published
+    };
+
+private:
+    // the index of the published frame has this bit set until the render thread reads it
+    static constexpr uint8_t NEW_FRAME {4};
+    static constexpr uint8_t INDEX {3};
+
+    std::array<Frame, 3> m_frames {};
+
+    uint8_t m_back {0}; // only used by the emulation thread
+    std::atomic<uint8_t> m_published {1};
+    uint8_t m_front {2}; // only used by the render thread
+
+public:
+    // emulation thread: the frame to fill before publishing it
+    Frame& back() { return m_frames[m_back]; }
+
+    // emulation thread: publishes the back frame, which is replaced by the previously published one.
+    // Returns false if that frame was never read by the render thread: in this case back() still contains it
+    bool publish()
+    {
+        const uint8_t previous = m_published.exchange(m_back | NEW_FRAME, std::memory_order_acq_rel);
+        m_back = previous & INDEX;
+
+        return (previous & NEW_FRAME) == 0;
+    }
+
+    // render thread: makes front() the last published frame; returns false if there is no new frame
+    bool acquire()
+    {
+        if ((m_published.load(std::memory_order_relaxed) & NEW_FRAME) == 0)
+        {
+            return false;
+        }
+
+        m_front = m_published.exchange(m_front, std::memory_order_acq_rel) & INDEX;
+
+        return true;
+    }
+
+    // render thread: the last frame acquired
+    const Frame& front() const { return m_frames[m_front]; }
+};
+
+// The fading levels of the pixels, owned by the render thread and computed from the frames it reads:
+// the pixels turned off since the previous frame start at the maximal fading level,
+// which is decreased by decreaseFadingLevel at every tick of 60 Hz, so that a pixel takes
+// the same time to fade whatever the frame rate of the renderer.
+class Chip8::FadingPlane {
+public:
+    static constexpr std::chrono::nanoseconds FADING_TICK {std::chrono::nanoseconds {std::chrono::seconds {1}} / 60};
+
+    // number of ticks needed by a pixel to fade to black (a quarter of a second)
+    static constexpr uint16_t FADING_DURATION {15};
+
 private:
-    std::array<std::array<Pixel, DISPLAY_WIDTH>, DISPLAY_HEIGHT> m_frame {};
+    // the level of the pixel at (row, column) is at row*DISPLAY_WIDTH + column.
+    // The fading level of a pixel that is on doesn't matter: it is set again when the pixel turns off.
+    // The plane is aligned so that decreaseFadingLevel can process it in whole vectors (look at fading.cpp)
+    alignas(32) std::array<uint16_t, Display::DISPLAY_WIDTH * Display::DISPLAY_HEIGHT> m_fadingLevels {};
 
     // it's the maximal value the fadingLevel of a pixel can have
     // The higher the MAXIMALFADING, the longer it will take for a pixel
     // to go completely black.
     // It has default value of 500, which results to the display showing
     // two different tones of grey every time a pixel is turned off
-    int32_t m_maximalFading;
+    uint16_t m_maximalFading;
+
+    // decrease of the fading levels at every tick
+    uint16_t m_fadingStep;
+
+    // the number of ticks before all the pixels are black again
+    uint16_t m_fadingTicks {0};
+
+    // the time of the last tick counted by decreaseFadingLevel
+    std::chrono::steady_clock::time_point m_lastTick {};
 
 public:
-    Display(Chip8::Fading fadingFlag) :
-        m_maximalFading {(fadingFlag == Fading::on) ? MAXIMAL_FADING_VALUE : 0}
+    FadingPlane(Chip8::Fading fadingFlag) :
+        m_maximalFading {(fadingFlag == Fading::on) ? uint16_t {Display::MAXIMAL_FADING_VALUE} : uint16_t {0}},
+        m_fadingStep {static_cast<uint16_t>((m_maximalFading + FADING_DURATION - 1) / FADING_DURATION)}
     {}
 
-    // decrease fading level by 1 (if > 0) for each pixel in the frame
-    void decreaseFadingLevel();
+    // starts the fading of the pixels turned off in the frame
+    void update(const FrameBuffer::Frame& frame);
 
-    // does xor of the sprite with the pixels starting at coordinate (x,y)
-    // returns true if this causes any pixel to be unset and false otherwise
-    // clips the pixels over the end of the screen
-    bool drwClip(std::vector<uint8_t>&& sprite, const uint8_t x, const uint8_t y);
+    // decreases the fading level of each pixel in the frame by m_fadingStep (down to 0)
+    // for every tick elapsed until now, using the widest saturating subtraction that the cpu supports.
+    // Returns true if any fading level changed, so that the frame must be shown again
+    bool decreaseFadingLevel(const std::chrono::steady_clock::time_point now);
 
-    // does xor of the sprite with the pixels starting at coordinate (x,y)
-    // returns true if this causes any pixel to be unset and false otherwise
-    // wraps the pixels over the end of the screen
-    bool drwWrap(std::vector<uint8_t>&& sprite, const uint8_t x, const uint8_t y);
+    Pixel getPixel(const FrameBuffer::Frame& frame, const int row, const int column) const
+    {
+        const bool isOn = (frame.m_pixels[row] >> (Display::DISPLAY_WIDTH - 1 - column)) & 1u;
+
+        return Pixel(isOn ? Status::on : Status::off, isOn ? 0 : m_fadingLevels[row*Display::DISPLAY_WIDTH + column]);
+    }
+};
+
+// The keyboard is written by the thread handling the events of the window and read by the emulation thread.
+// The keys currently pressed are the bits of a single atomic word, so that skp and sknp only load it.
+// Every press and release is also pushed in a single-producer single-consumer queue,
+// from which the emulation thread learns the order of the events (needed by ldVxK).
+class Chip8::Keyboard {
+public:
+    struct Edge {
+        Register m_key;
+        bool m_pressed;
+    };
+
+private:
+    // a power of 2, so that the indices can grow indefinitely and wrap around
+    static constexpr uint32_t QUEUE_SIZE {64};
+
+    std::atomic<uint16_t> m_pressedKeys {0}; // bit k is set if the key k is pressed
+
+    std::array<Edge, QUEUE_SIZE> m_edges {};
+    std::atomic<uint32_t> m_head {0}; // next edge to be written, only changed by the window thread
+    std::atomic<uint32_t> m_tail {0}; // next edge to be read, only changed by the emulation thread
+
+    // incremented by every event, so that the emulation thread can wait for the next one
+    std::atomic<uint32_t> m_events {0};
+
+    // window thread: if the queue is full the edge is dropped, but m_pressedKeys is still right
+    void push(const Edge edge)
+    {
+        const uint32_t head = m_head.load(std::memory_order_relaxed);
+
+        if (head - m_tail.load(std::memory_order_acquire) < QUEUE_SIZE)
+        {
+            m_edges[head % QUEUE_SIZE] = edge;
+            m_head.store(head + 1, std::memory_order_release);
+        }
+
+        notify();
+    }
+
+public:
+    // window thread: the key has been pressed
+    void press(const Register key)
+    {
+        m_pressedKeys.fetch_or(static_cast<uint16_t>(1u << key), std::memory_order_relaxed);
+        push({key, true});
+    }
+
+    // window thread: the key has been released
+    void release(const Register key)
+    {
+        m_pressedKeys.fetch_and(static_cast<uint16_t>(~(1u << key)), std::memory_order_relaxed);
+        push({key, false});
+    }
+
+    // wakes up the emulation thread waiting in waitForEvent (for example when the window is closed)
+    void notify()
+    {
+        m_events.fetch_add(1, std::memory_order_release);
+        m_events.notify_all();
+    }
+
+    // bit k is set if the key k is pressed (used by saveState and loadState)
+    uint16_t getPressedKeys() const
+    {
+        return m_pressedKeys.load(std::memory_order_relaxed);
+    }
+
+    void setPressedKeys(const uint16_t pressedKeys)
+    {
+        m_pressedKeys.store(pressedKeys, std::memory_order_relaxed);
+    }
 
-    const std::array<std::array<Pixel, DISPLAY_WIDTH>, DISPLAY_HEIGHT>* getDisplayFrame()
+    // emulation thread: the values in the registers can be larger than the number of keys
+    bool isPressed(const Register key) const
     {
-        return &m_frame;
+        return key < 16 && ((m_pressedKeys.load(std::memory_order_relaxed) >> key) & 1u);
     }
+
+    // emulation thread: takes the oldest edge in the queue, if any
+    std::optional<Edge> pop()
+    {
+        const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+
+        if (tail == m_head.load(std::memory_order_acquire))
+        {
+            return std::nullopt;
+        }
+
+        const Edge edge {m_edges[tail % QUEUE_SIZE]};
+        m_tail.store(tail + 1, std::memory_order_release);
+
+        return edge;
+    }
+
+    // emulation thread: the events counted so far, to be passed to waitForEvent
+    uint32_t getEvents() const { return m_events.load(std::memory_order_acquire); }
+
+    // emulation thread: returns as soon as there has been an event after getEvents returned events
+    void waitForEvent(const uint32_t events) const { m_events.wait(events, std::memory_order_acquire); }
+};
+
+// The block cache stores, for every address of the ram, the decoded instruction starting at that address
+// and the length of the block starting at that address (0 if there is none).
+// A block is a straight-line run of instructions that ends with the first instruction for which
+// endsBlock is true, or after MAXIMAL_BLOCK_LENGTH instructions.
+// Blocks starting at different addresses can overlap and share their decoded instructions.
+class Chip8::BlockCache {
+public:
+    static constexpr int MAXIMAL_BLOCK_LENGTH {32};
+
+    std::array<DecodedInstruction, 4096> m_decoded {};
+
+    std::array<uint8_t, 4096> m_blockLength {};
+
+    // the bytes of the ram that belong to some block, so that the writes in ram
+    // outside of the blocks can be ignored without looking for the blocks they touch
+    std::bitset<4096> m_isCode {};
+
+    BlockCacheStatistics m_statistics {};
+
+    // discards the blocks containing some of the bytes between first and last (included)
+    void invalidate(const Address first, const Address last);
 };
+
+// The jit counts how many times the interpreter reaches every address of the ram and,
+// when an address becomes hot, it translates the block starting there into native code (look at jit.cpp).
+// A block is a straight-line run of instructions that the jit knows how to translate,
+// possibly ended by a jump or by a conditional skip; the instructions it can't translate
+// (drawing, keyboard, timers, writes in ram, ...) are left to the interpreter.
+class Chip8::Jit {
+public:
+    // a compiled block receives the registers V0..VF, the address of the register I
+    // and the number of its instructions to execute (at least one and at most its length);
+    // it returns the new value of the program counter
+    using Function = Address (*)(Register*, Address*, uint32_t);
+
+    static constexpr int MAXIMAL_BLOCK_LENGTH {64};
+
+    // number of times the interpreter must reach an address before the block starting there is compiled
+    static constexpr uint16_t HOTNESS_THRESHOLD {16};
+
+    // hotness of the addresses whose first instruction can't be compiled
+    static constexpr uint16_t NOT_COMPILABLE {0xffff};
+
+    // size of the buffer of native code: when it is full, all the compiled blocks are discarded
+    static constexpr size_t CODE_SIZE {1 << 20};
+
+    struct Block {
+        Function m_function; // nullptr if the block has not been compiled
+        uint8_t m_length;
+        uint16_t m_hotness;
+    };
+
+    std::array<Block, 4096> m_blocks {};
+
+    // the bytes of the ram that belong to some compiled block (or to an instruction that can't be compiled),
+    // so that the writes in ram outside of them can be ignored
+    std::bitset<4096> m_isCode {};
+
+    JitStatistics m_statistics {};
+
+    Jit();
+    ~Jit();
+
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    // compiles the block starting at address pc;
+    // returns false (and marks the address as NOT_COMPILABLE) if its first instruction can't be compiled
+    bool compile(const std::array<Register, 4096>& ram, const Address pc);
+
+    // discards the blocks containing some of the bytes between first and last (included)
+    void invalidate(const Address first, const Address last);
+
+private:
+    uint8_t* m_code {nullptr}; // buffer of native code, nullptr if the jit is not available
+    size_t m_codeUsed {0};
+
+    // discards all the compiled blocks
+    void flush();
+};
+
+// The recompiled blocks of the rom in ram, indexed by their first address.
+// Unlike the blocks of the jit, they never change, but they are discarded
+// as soon as the program writes over them.
+class Chip8::RecompiledCode {
+public:
+    // the blocks emitted by chip8_recompiler are never longer than this
+    static constexpr int MAXIMAL_BLOCK_LENGTH {64};
+
+    std::array<const RecompiledBlock*, 4096> m_blocks {};
+
+    // the bytes of the ram that belong to some recompiled block
+    std::bitset<4096> m_isCode {};
+
+    RecompiledStatistics m_statistics {};
+
+    // discards the blocks containing some of the bytes between first and last (included)
+    void invalidate(const Address first, const Address last);
+};
+
+// The fusions found in ram, indexed by the address of their first instruction.
+// A fusion is executed only if the program counter reaches its first instruction,
+// so jumping in the middle of it executes the single instructions as usual.
+class Chip8::Fusions {
+public:
+    enum class Kind : uint8_t {none, loadDelayTimer, waitDelayTimer, loadIAndDraw};
+
+    static constexpr int MAXIMAL_FUSION_LENGTH {3};
+
+    struct Fusion {
+        Kind m_kind;
+        uint8_t m_length; // number of instructions fused
+        uint8_t m_x;
+        uint8_t m_kk;
+        uint16_t m_nnn;
+        const DecodedInstruction* m_last; // the decoded Dxyn of loadIAndDraw
+    };
+
+    std::array<Fusion, 4096> m_fusions {};
+
+    FusionStatistics m_statistics {};
+
+    // discards the fusions containing some of the bytes between first and last (included)
+    void invalidate(const Address first, const Address last);
+};
+
+struct Chip8::Machine
+{
+    Chip8& m_chip8;
+
+    std::array<Register, 16>& registers() { return m_chip8.m_registers; }
+    Address& I() { return m_chip8.m_I; }
+    Address& PC() { return m_chip8.m_PC; }
+    uint8_t& SP() { return m_chip8.m_SP; }
+
+    Address& stack(const uint8_t sp) { return m_chip8.m_stack[sp]; }
+    uint8_t& ram(const size_t address) { return (*m_chip8.m_ramPtr)[address]; }
+
+    void ramWritten(const size_t first, const size_t last)
+    {
+        m_chip8.ramWritten(static_cast<Address>(first), static_cast<Address>(last));
+    }
+
+    bool isPressed(const Register key) const { return m_chip8.m_keyboard->isPressed(key); }
+
+    // the sprite is read in place from the ram; its rows past the end of the ram are not drawn
+    bool draw(const uint8_t x, const uint8_t y, const uint8_t n, const bool wrap)
+    {
+        const std::array<Register, 4096>& ram {*m_chip8.m_ramPtr};
+        const size_t first = std::min<size_t>(m_chip8.m_I, ram.size());
+        const std::span<const uint8_t> sprite {ram.data() + first, std::min<size_t>(n, ram.size() - first)};
+
+        return wrap ? m_chip8.m_display->drwWrap(sprite, x, y) : m_chip8.m_display->drwClip(sprite, x, y);
+    }
+};
+
+// instruction 00ee, defined here since it needs Machine to be complete
+inline void Chip8::ret()
+{
+    instructions::ret(Machine {*this});
+}
+
+// definitions of the templates depending on the quirks
+#include "chip8_quirks.inl"
@@ -0,0 +1,58 @@
+#pragma once
+
+// Included at the end of chip8.h: the instructions depending on the quirks are templates,
+// and the dispatch tables (look at dispatch.cpp) instantiate them as well as execute.
+// Their semantics are in instructions.h, shared with Chip8Lite: here the quirks Q become constants.
+
+#include <utility>
+
+template <typename F>
+auto Chip8::withQuirks(const Quirks quirks, F&& f)
+{
+    return [&]<size_t... indices>(std::index_sequence<indices...>)
+    {
+        decltype(f.template operator()<ALL_QUIRKS[0]>()) res {};
+
+        // only the call for the combination equal to quirks is evaluated
+        static_cast<void>(((quirks == ALL_QUIRKS[indices] && (res = f.template operator()<ALL_QUIRKS[indices]>(), true)) || ...));
+
+        return res;
+    }(std::make_index_sequence<ALL_QUIRKS.size()>{});
+}
+
+template <Chip8::Quirks Q>
+void Chip8::shr(const uint8_t x, const uint8_t y)
+{
+    instructions::shr(Machine {*this}, x, y, Q.m_instructionSet == InstructionSet::schip8);
+}
+
+template <Chip8::Quirks Q>
+void Chip8::shl(const uint8_t x, const uint8_t y)
+{
+    instructions::shl(Machine {*this}, x, y, Q.m_instructionSet == InstructionSet::schip8);
+}
+
+template <Chip8::Quirks Q>
+void Chip8::drw(const uint8_t x, const uint8_t y, const uint8_t n)
+{
+    // the program counter goes back so that the instruction is executed again, until the vertical blank
+    if (m_waitForVBlank && !reachedVBlank())
+    {
+        m_PC = static_cast<Address>(m_PC - 2);
+        return;
+    }
+
+    instructions::drw(Machine {*this}, x, y, n, Q.m_drawBehaviour == DrawBehaviour::wrap);
+}
+
+template <Chip8::Quirks Q>
+void Chip8::ldIVx(const uint8_t x)
+{
+    instructions::ldIVx(Machine {*this}, x, Q.m_instructionSet == InstructionSet::schip8);
+}
+
+template <Chip8::Quirks Q>
+void Chip8::ldVxI(const uint8_t x)
+{
+    instructions::ldVxI(Machine {*this}, x, Q.m_instructionSet == InstructionSet::schip8);
+}
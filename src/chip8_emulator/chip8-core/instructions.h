@@ -0,0 +1,312 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// The semantics of the instructions, shared by Chip8 and Chip8Lite so that a fix (or a new quirk)
+// lands in both of them. The instructions work on a machine m, a small accessor passed by value
+// (Chip8::Machine and Chip8Lite::Machine) giving them:
+// - m.registers(), m.I(), m.PC() and m.SP(), references to the registers;
+// - m.stack(sp) and m.ram(address), references to the level sp of the stack and to a byte of the ram
+//   (Chip8Lite reduces sp and address to the size of its stack and of its ram);
+// - m.ramWritten(first, last), called after the instruction wrote the bytes from first to last (included);
+// - m.isPressed(key), false for the values above 0xf, which are never pressed;
+// - m.draw(x, y, n, wrap), which draws the sprite of n rows at I with its top left corner at (x, y),
+//   clipping or wrapping the pixels past the borders, and tells if a pixel was unset.
+// As in Chip8::execute, the instructions which don't jump leave the program counter on themselves:
+// the caller moves it to the next instruction. The quirks are plain arguments, so that they are folded
+// when they are known at compile time (Chip8) and tested at every instruction when they are not (Chip8Lite).
+// 00e0, cxkk (but for its mask), the timers and fx0a depend on how each machine keeps its display, its random
+// numbers, its timers and its keyboard, so they are left to the machines.
+namespace instructions
+{
+    // instruction 00ee
+    template <typename M>
+    void ret(M m)
+    {
+        m.PC() = m.stack(m.SP());
+        --m.SP();
+    }
+
+    // instruction 1nnn
+    template <typename M>
+    void jp(M m, const uint16_t nnn)
+    {
+        m.PC() = nnn;
+    }
+
+    // instruction 2nnn
+    template <typename M>
+    void call(M m, const uint16_t nnn)
+    {
+        ++m.SP();
+        m.stack(m.SP()) = m.PC();
+        m.PC() = nnn;
+    }
+
+    // the skips move the program counter over the next instruction
+    template <typename M>
+    void skipIf(M m, const bool condition)
+    {
+        if (condition)
+        {
+            m.PC() = static_cast<uint16_t>(m.PC() + 2);
+        }
+    }
+
+    // instruction 3xkk
+    template <typename M>
+    void se(M m, const uint8_t x, const uint8_t kk)
+    {
+        skipIf(m, m.registers()[x] == kk);
+    }
+
+    // instruction 4xkk
+    template <typename M>
+    void sne(M m, const uint8_t x, const uint8_t kk)
+    {
+        skipIf(m, m.registers()[x] != kk);
+    }
+
+    // instruction 5xy0
+    template <typename M>
+    void seVxVy(M m, const uint8_t x, const uint8_t y)
+    {
+        skipIf(m, m.registers()[x] == m.registers()[y]);
+    }
+
+    // instruction 6xkk
+    template <typename M>
+    void ld(M m, const uint8_t x, const uint8_t kk)
+    {
+        m.registers()[x] = kk;
+    }
+
+    // instruction 7xkk
+    template <typename M>
+    void add(M m, const uint8_t x, const uint8_t kk)
+    {
+        m.registers()[x] = static_cast<uint8_t>(m.registers()[x] + kk);
+    }
+
+    // instruction 8xy0
+    template <typename M>
+    void ldVxVy(M m, const uint8_t x, const uint8_t y)
+    {
+        m.registers()[x] = m.registers()[y];
+    }
+
+    // instruction 8xy1
+    template <typename M>
+    void bitOr(M m, const uint8_t x, const uint8_t y)
+    {
+        m.registers()[x] = m.registers()[x] | m.registers()[y];
+    }
+
+    // instruction 8xy2
+    template <typename M>
+    void bitAnd(M m, const uint8_t x, const uint8_t y)
+    {
+        m.registers()[x] = m.registers()[x] & m.registers()[y];
+    }
+
+    // instruction 8xy3
+    template <typename M>
+    void bitXor(M m, const uint8_t x, const uint8_t y)
+    {
+        m.registers()[x] = m.registers()[x] ^ m.registers()[y];
+    }
+
+    // instruction 8xy4
+    template <typename M>
+    void addVxVy(M m, const uint8_t x, const uint8_t y)
+    {
+        auto& V = m.registers();
+
+        V[x] = static_cast<uint8_t>(V[x] + V[y]);
+        V[0xf] = (V[x] < V[y]) ? 1 : 0;
+    }
+
+    // instruction 8xy5
+    template <typename M>
+    void sub(M m, const uint8_t x, const uint8_t y)
+    {
+        auto& V = m.registers();
+        const uint8_t val_x = V[x];
+        const uint8_t val_y = V[y];
+
+        V[x] = static_cast<uint8_t>(val_x - val_y);
+        V[0xf] = (val_x >= val_y) ? 1 : 0;
+    }
+
+    // instruction 8xy6: schip8 shifts Vx, chip8 shifts Vy into Vx.
+    // schip8 sets VF before Vx, chip8 after it, which matters for 8fy6
+    template <typename M>
+    void shr(M m, const uint8_t x, const uint8_t y, const bool schip8)
+    {
+        auto& V = m.registers();
+
+        if (schip8)
+        {
+            V[0xf] = V[x] & 0b1;
+            V[x] = V[x] >> 1u;
+        }
+        else
+        {
+            const uint8_t val_y = V[y];
+            V[x] = val_y >> 1u;
+            V[0xf] = val_y & 0b1;
+        }
+    }
+
+    // instruction 8xy7
+    template <typename M>
+    void subn(M m, const uint8_t x, const uint8_t y)
+    {
+        auto& V = m.registers();
+        const uint8_t val_x = V[x];
+        const uint8_t val_y = V[y];
+
+        V[x] = static_cast<uint8_t>(val_y - val_x);
+        V[0xf] = (val_y > val_x) ? 1 : 0;
+    }
+
+    // instruction 8xye: schip8 shifts Vx, chip8 shifts Vy into Vx.
+    // As in 8xy6, schip8 sets VF before Vx and chip8 after it; chip8 leaves the bit shifted out
+    // where it was (VF is 0 or 0x80), schip8 sets VF to 0 or 1
+    template <typename M>
+    void shl(M m, const uint8_t x, const uint8_t y, const bool schip8)
+    {
+        auto& V = m.registers();
+
+        if (schip8)
+        {
+            const uint8_t val_x = V[x];
+            V[0xf] = val_x >> 7u;
+            V[x] = static_cast<uint8_t>(val_x << 1u);
+        }
+        else
+        {
+            const uint8_t val_y = V[y];
+            V[x] = static_cast<uint8_t>(val_y << 1u);
+            V[0xf] = val_y & 0b10000000;
+        }
+    }
+
+    // instruction 9xy0
+    template <typename M>
+    void sneVxVy(M m, const uint8_t x, const uint8_t y)
+    {
+        skipIf(m, m.registers()[x] != m.registers()[y]);
+    }
+
+    // instruction annn
+    template <typename M>
+    void ldI(M m, const uint16_t nnn)
+    {
+        m.I() = nnn;
+    }
+
+    // instruction bnnn
+    template <typename M>
+    void jpV0(M m, const uint16_t nnn)
+    {
+        m.PC() = static_cast<uint16_t>(m.registers()[0] + nnn);
+    }
+
+    // instruction cxkk, with the random number drawn by the machine
+    template <typename M>
+    void rnd(M m, const uint8_t x, const uint8_t kk, const uint8_t randomNumber)
+    {
+        m.registers()[x] = randomNumber & kk;
+    }
+
+    // instruction dxyn
+    template <typename M>
+    void drw(M m, const uint8_t x, const uint8_t y, const uint8_t n, const bool wrap)
+    {
+        auto& V = m.registers();
+
+        const bool pixelWasUnset = m.draw(static_cast<uint8_t>(V[x] % 64), static_cast<uint8_t>(V[y] % 32), n, wrap);
+
+        V[0xf] = pixelWasUnset ? 1 : 0;
+    }
+
+    // instruction ex9e
+    template <typename M>
+    void skp(M m, const uint8_t x)
+    {
+        skipIf(m, m.isPressed(m.registers()[x]));
+    }
+
+    // instruction exa1
+    template <typename M>
+    void sknp(M m, const uint8_t x)
+    {
+        skipIf(m, !m.isPressed(m.registers()[x]));
+    }
+
+    // instruction fx1e
+    template <typename M>
+    void addI(M m, const uint8_t x)
+    {
+        m.I() = static_cast<uint16_t>(m.registers()[x] + m.I());
+    }
+
+    // instruction fx29
+    template <typename M>
+    void ldFVx(M m, const uint8_t x)
+    {
+        m.I() = static_cast<uint16_t>(m.registers()[x] * 5);
+    }
+
+    // instruction fx33
+    template <typename M>
+    void ldB(M m, const uint8_t x)
+    {
+        const uint8_t val_x = m.registers()[x];
+        const size_t first = m.I();
+
+        m.ram(first) = static_cast<uint8_t>(val_x / 100);
+        m.ram(first + 1) = static_cast<uint8_t>((val_x / 10) % 10);
+        m.ram(first + 2) = static_cast<uint8_t>(val_x % 10);
+
+        m.ramWritten(first, first + 2);
+    }
+
+    // instruction fx55: chip8 leaves I after the last register stored, schip8 doesn't move it
+    template <typename M>
+    void ldIVx(M m, const uint8_t x, const bool schip8)
+    {
+        const size_t first = m.I();
+
+        for (size_t i = 0; i <= x; ++i)
+        {
+            m.ram(first + i) = m.registers()[i];
+        }
+
+        if (!schip8)
+        {
+            m.I() = static_cast<uint16_t>(first + x + 1);
+        }
+
+        m.ramWritten(first, first + x);
+    }
+
+    // instruction fx65: chip8 leaves I after the last register loaded, schip8 doesn't move it
+    template <typename M>
+    void ldVxI(M m, const uint8_t x, const bool schip8)
+    {
+        const size_t first = m.I();
+
+        for (size_t i = 0; i <= x; ++i)
+        {
+            m.registers()[i] = m.ram(first + i);
+        }
+
+        if (!schip8)
+        {
+            m.I() = static_cast<uint16_t>(first + x + 1);
+        }
+    }
+}
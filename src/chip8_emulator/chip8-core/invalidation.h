@@ -0,0 +1,58 @@
+#pragma once
+
+#include <algorithm>
+#include <bitset>
+#include <cstddef>
+
+// The engines translating the code of the rom (the block cache, the jit, the recompiled code and the fusions)
+// keep a table indexed by the address of the first instruction of every piece of code they translated:
+// the piece starting at the address start covers the bytes from start to start + 2*length - 1,
+// where length is at most maximalLength. So when the program writes the bytes from first to last,
+// only the pieces starting at most 2*maximalLength - 1 bytes before first can be touched by the write.
+// lengthAt(start) returns the length of the piece starting at start (0 if there is none),
+// and discard(start) is called for every piece touched by the write
+template<typename LengthAt, typename Discard>
+void discardOverlappingCode(const size_t first, const size_t last, const size_t tableSize, const size_t maximalLength,
+    LengthAt lengthAt, Discard discard)
+{
+    const size_t end = std::min(last, tableSize - 1);
+    const size_t begin = (first >= 2*maximalLength - 1) ? first - (2*maximalLength - 1) : 0;
+
+    for (size_t start = begin; start <= end; ++start)
+    {
+        const size_t length = lengthAt(start);
+
+        if (length != 0 && start + 2*length > first)
+        {
+            discard(start);
+        }
+    }
+}
+
+// same as above for the engines which also mark in isCode the bytes belonging to some piece of code:
+// the table is looked at only if the program wrote over some of them, since writing on data is the most common case.
+// Afterwards, all the pieces containing the bytes written have been discarded
+template<size_t N, typename LengthAt, typename Discard>
+void discardOverlappingCode(std::bitset<N>& isCode, const size_t first, const size_t last, const size_t maximalLength,
+    LengthAt lengthAt, Discard discard)
+{
+    const size_t end = std::min(last, N - 1);
+
+    bool touchesCode = false;
+    for (size_t address = first; address <= end; ++address)
+    {
+        touchesCode = touchesCode || isCode[address];
+    }
+
+    if (!touchesCode)
+    {
+        return;
+    }
+
+    discardOverlappingCode(first, last, N, maximalLength, lengthAt, discard);
+
+    for (size_t address = first; address <= end; ++address)
+    {
+        isCode[address] = false;
+    }
+}
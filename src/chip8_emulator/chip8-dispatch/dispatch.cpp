@@ -0,0 +1,201 @@
+#include <dispatch.h>
+
+template <Chip8::Quirks Q>
+Chip8::DecodedInstruction Chip8::decode(const Instruction i)
+{
+    uint16_t instruction = i.m_inst;
+
+    DecodedInstruction decoded {
+        &Dispatch::skipUnknown,
+        static_cast<uint16_t>(instruction & 0xfff),
+        static_cast<uint8_t>((instruction & 0xf00) >> 8u),
+        static_cast<uint8_t>((instruction & 0xf0) >> 4u),
+        static_cast<uint8_t>(instruction & 0xff),
+        static_cast<uint8_t>(instruction & 0xf)
+    };
+
+    switch ((instruction & 0xf000) >> 12u)
+    {
+    case 0:
+        if (instruction == 0x00e0)
+        {
+            decoded.m_handler = &Dispatch::cls;
+        }
+        else if (instruction == 0x00ee)
+        {
+            decoded.m_handler = &Dispatch::ret;
+        }
+        break;
+
+    case 1:
+        decoded.m_handler = &Dispatch::jp;
+        break;
+
+    case 2:
+        decoded.m_handler = &Dispatch::call;
+        break;
+
+    case 3:
+        decoded.m_handler = &Dispatch::se;
+        break;
+
+    case 4:
+        decoded.m_handler = &Dispatch::sne;
+        break;
+
+    case 5:
+        decoded.m_handler = &Dispatch::seVxVy;
+        break;
+
+    case 6:
+        decoded.m_handler = &Dispatch::ld;
+        break;
+
+    case 7:
+        decoded.m_handler = &Dispatch::add;
+        break;
+
+    case 8:
+        switch (decoded.m_n)
+        {
+        case 0: decoded.m_handler = &Dispatch::ldVxVy; break;
+        case 1: decoded.m_handler = &Dispatch::bitOr; break;
+        case 2: decoded.m_handler = &Dispatch::bitAnd; break;
+        case 3: decoded.m_handler = &Dispatch::bitXor; break;
+        case 4: decoded.m_handler = &Dispatch::addVxVy; break;
+        case 5: decoded.m_handler = &Dispatch::sub; break;
+        case 6: decoded.m_handler = &Dispatch::shr<Q>; break;
+        case 7: decoded.m_handler = &Dispatch::subn; break;
+        case 0xe: decoded.m_handler = &Dispatch::shl<Q>; break;
+        default: decoded.m_handler = &Dispatch::stopUnknown; break;
+        }
+        break;
+
+    case 9:
+        decoded.m_handler = (decoded.m_n == 0) ? &Dispatch::sneVxVy : &Dispatch::stopUnknown;
+        break;
+
+    case 0xa:
+        decoded.m_handler = &Dispatch::ldI;
+        break;
+
+    case 0xb:
+        decoded.m_handler = &Dispatch::jpV0;
+        break;
+
+    case 0xc:
+        decoded.m_handler = &Dispatch::rnd;
+        break;
+
+    case 0xd:
+        decoded.m_handler = &Dispatch::drw<Q>;
+        break;
+
+    case 0xe:
+        switch (decoded.m_kk)
+        {
+        case 0x9e: decoded.m_handler = &Dispatch::skp; break;
+        case 0xa1: decoded.m_handler = &Dispatch::sknp; break;
+        default: decoded.m_handler = &Dispatch::stopUnknown; break;
+        }
+        break;
+
+    case 0xf:
+        switch (decoded.m_kk)
+        {
+        case 0x07: decoded.m_handler = &Dispatch::ldVxDT; break;
+        case 0x0a: decoded.m_handler = &Dispatch::ldVxK; break;
+        case 0x15: decoded.m_handler = &Dispatch::ldDTVx; break;
+        case 0x18: decoded.m_handler = &Dispatch::ldSTVx; break;
+        case 0x1e: decoded.m_handler = &Dispatch::addI; break;
+        case 0x29: decoded.m_handler = &Dispatch::ldFVx; break;
+        case 0x33: decoded.m_handler = &Dispatch::ldB; break;
+        case 0x55: decoded.m_handler = &Dispatch::ldIVx<Q>; break;
+        case 0x65: decoded.m_handler = &Dispatch::ldVxI<Q>; break;
+        default: break;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return decoded;
+}
+
+bool Chip8::endsBlock(const DecodedInstruction& decoded) const
+{
+    const Handler h = decoded.m_handler;
+
+    const Handler storeRegisters = withQuirks(m_quirks, []<Quirks Q>() { return Handler {&Dispatch::ldIVx<Q>}; });
+
+    // dxyn waiting for the vertical blank is executed again, as fx0a
+    if (m_waitForVBlank && h == withQuirks(m_quirks, []<Quirks Q>() { return Handler {&Dispatch::drw<Q>}; }))
+    {
+        return true;
+    }
+
+    return h == &Dispatch::ret || h == &Dispatch::jp || h == &Dispatch::call || h == &Dispatch::jpV0 ||
+        h == &Dispatch::se || h == &Dispatch::sne || h == &Dispatch::seVxVy || h == &Dispatch::sneVxVy ||
+        h == &Dispatch::skp || h == &Dispatch::sknp || h == &Dispatch::ldVxK || h == &Dispatch::stopUnknown ||
+        h == &Dispatch::ldB || h == storeRegisters;
+}
+
+// every table takes 1 MiB, so it is allocated on the heap, only once for all the Chip8s with the same quirks;
+// the initialization of a static local variable is thread safe
+template <Chip8::Quirks Q>
+const Chip8::DispatchTable& Chip8::dispatchTable()
+{
+    static const std::unique_ptr<DispatchTable> table = []
+    {
+        std::unique_ptr<DispatchTable> res = std::make_unique<DispatchTable>();
+
+        for (size_t inst = 0; inst < res->size(); ++inst)
+        {
+            (*res)[inst] = decode<Q>(Instruction(static_cast<uint16_t>(inst)));
+        }
+
+        return res;
+    }();
+
+    return *table;
+}
+
+void Chip8::setEngine(const Engine engine)
+{
+    // the other engines use the table for the instructions they don't handle themselves,
+    // and the engine threaded to find the label of every instruction
+    if (engine != Engine::switchCase)
+    {
+        m_dispatchTable = withQuirks(m_quirks, []<Quirks Q>() { return &dispatchTable<Q>(); });
+    }
+
+    if (engine == Engine::blockCache && !m_blockCache)
+    {
+        m_blockCache = std::make_unique<BlockCache>();
+    }
+
+    if (engine == Engine::jit && !m_jit)
+    {
+        m_jit = std::make_unique<Jit>();
+    }
+
+    if (engine == Engine::recompiled && !m_recompiledCode)
+    {
+        m_recompiledCode = std::make_unique<RecompiledCode>();
+        attachRecompiledProgram();
+    }
+
+    if (engine == Engine::fused && !m_fusions)
+    {
+        m_fusions = std::make_unique<Fusions>();
+        fuseInstructions();
+    }
+
+    if (engine == Engine::threaded)
+    {
+        selectThreaded();
+    }
+
+    m_engine = engine;
+}
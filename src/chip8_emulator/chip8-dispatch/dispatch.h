@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chip8.h>
+
+// The handlers of the decoded instructions call the same member functions used by execute,
+// so the two engines share the behaviour of the instructions.
+// They also take care of moving the program counter (and of yielding after dxyn)
+// exactly as the corresponding cases of the switch in execute do.
+// The engine threaded gives a label to each of them (look at threaded.cpp).
+struct Chip8::Dispatch
+{
+    static void next(Chip8& c) { c.m_PC = static_cast<Address>(c.m_PC + 2); }
+
+    // instructions that are not recognized by execute:
+    // some of them are skipped, others leave the program counter where it is
+    static void skipUnknown(Chip8& c, const DecodedInstruction&) { next(c); }
+    static void stopUnknown(Chip8&, const DecodedInstruction&) {}
+
+    static void cls(Chip8& c, const DecodedInstruction&) { c.cls(); next(c); }
+    static void ret(Chip8& c, const DecodedInstruction&) { c.ret(); next(c); }
+    static void jp(Chip8& c, const DecodedInstruction& d) { c.jp(d.m_nnn); }
+    static void call(Chip8& c, const DecodedInstruction& d) { c.call(d.m_nnn); }
+    static void se(Chip8& c, const DecodedInstruction& d) { c.se(d.m_x, d.m_kk); next(c); }
+    static void sne(Chip8& c, const DecodedInstruction& d) { c.sne(d.m_x, d.m_kk); next(c); }
+    static void seVxVy(Chip8& c, const DecodedInstruction& d) { c.seVxVy(d.m_x, d.m_y); next(c); }
+    static void ld(Chip8& c, const DecodedInstruction& d) { c.ld(d.m_x, d.m_kk); next(c); }
+    static void add(Chip8& c, const DecodedInstruction& d) { c.add(d.m_x, d.m_kk); next(c); }
+    static void ldVxVy(Chip8& c, const DecodedInstruction& d) { c.ldVxVy(d.m_x, d.m_y); next(c); }
+    static void bitOr(Chip8& c, const DecodedInstruction& d) { c.bitOr(d.m_x, d.m_y); next(c); }
+    static void bitAnd(Chip8& c, const DecodedInstruction& d) { c.bitAnd(d.m_x, d.m_y); next(c); }
+    static void bitXor(Chip8& c, const DecodedInstruction& d) { c.bitXor(d.m_x, d.m_y); next(c); }
+    static void addVxVy(Chip8& c, const DecodedInstruction& d) { c.addVxVy(d.m_x, d.m_y); next(c); }
+    static void sub(Chip8& c, const DecodedInstruction& d) { c.sub(d.m_x, d.m_y); next(c); }
+    template <Quirks Q>
+    static void shr(Chip8& c, const DecodedInstruction& d) { c.shr<Q>(d.m_x, d.m_y); next(c); }
+    static void subn(Chip8& c, const DecodedInstruction& d) { c.subn(d.m_x, d.m_y); next(c); }
+    template <Quirks Q>
+    static void shl(Chip8& c, const DecodedInstruction& d) { c.shl<Q>(d.m_x, d.m_y); next(c); }
+    static void sneVxVy(Chip8& c, const DecodedInstruction& d) { c.sneVxVy(d.m_x, d.m_y); next(c); }
+    static void ldI(Chip8& c, const DecodedInstruction& d) { c.ldI(d.m_nnn); next(c); }
+    static void jpV0(Chip8& c, const DecodedInstruction& d) { c.jpV0(d.m_nnn); }
+    static void rnd(Chip8& c, const DecodedInstruction& d) { c.rnd(d.m_x, d.m_kk); next(c); }
+
+    template <Quirks Q>
+    static void drw(Chip8& c, const DecodedInstruction& d)
+    {
+        c.drw<Q>(d.m_x, d.m_y, d.m_n);
+
+        // waiting for the vertical blank, the thread sleeps at the end of the frame instead
+        if (!c.m_waitForVBlank)
+        {
+            std::this_thread::yield();
+        }
+
+        next(c);
+    }
+
+    static void skp(Chip8& c, const DecodedInstruction& d)
+    {
+        c.skp(d.m_x);
+        next(c);
+    }
+
+    static void sknp(Chip8& c, const DecodedInstruction& d)
+    {
+        c.sknp(d.m_x);
+        next(c);
+    }
+
+    static void ldVxDT(Chip8& c, const DecodedInstruction& d) { c.ldVxDT(d.m_x); next(c); }
+    static void ldVxK(Chip8& c, const DecodedInstruction& d) { c.ldVxK(d.m_x); next(c); }
+    static void ldDTVx(Chip8& c, const DecodedInstruction& d) { c.ldDTVx(d.m_x); next(c); }
+    static void ldSTVx(Chip8& c, const DecodedInstruction& d) { c.ldSTVx(d.m_x); next(c); }
+    static void addI(Chip8& c, const DecodedInstruction& d) { c.addI(d.m_x); next(c); }
+    static void ldFVx(Chip8& c, const DecodedInstruction& d) { c.ldFVx(d.m_x); next(c); }
+    static void ldB(Chip8& c, const DecodedInstruction& d) { c.ldB(d.m_x); next(c); }
+
+    template <Quirks Q>
+    static void ldIVx(Chip8& c, const DecodedInstruction& d) { c.ldIVx<Q>(d.m_x); next(c); }
+
+    template <Quirks Q>
+    static void ldVxI(Chip8& c, const DecodedInstruction& d) { c.ldVxI<Q>(d.m_x); next(c); }
+};
@@ -1,4 +1,6 @@
 #include <chip8_emulator.h>
+#include <iostream>
+#include <chrono>
 
 std::optional<uint8_t> Chip8Emulator::getChip8Key(SDL_Scancode pressedKey) const
 // The keys are used to simulate the keyboard of the chip8 are the following:
@@ -102,55 +104,91 @@ std::optional<uint8_t> Chip8Emulator::getChip8Key(SDL_Scancode pressedKey) const
     #pragma GCC diagnostic pop
 }
 
-void Chip8Emulator::renderDisplay(SDL_Renderer* renderer)
+namespace
 {
-    // every time we show a new frame, the fading level of the pixels decreases
-    if (m_chip8.m_fadingFlag == Chip8::Fading::on)
+    // colors of the texture, in the format SDL_PIXELFORMAT_RGBA8888
+    constexpr uint32_t rgba(const uint32_t red, const uint32_t green, const uint32_t blue)
     {
-        m_chip8.m_display->decreaseFadingLevel();
+        return (red << 24u) | (green << 16u) | (blue << 8u) | 0xffu;
     }
 
-    // sets the background color to black
-    SDL_SetRenderDrawColor(renderer, 0,0,0, 255);
-    SDL_RenderClear(renderer);
+    constexpr uint32_t WHITE {rgba(255, 255, 255)};
 
-    const std::array<std::array<Chip8::Pixel, Chip8::Display::DISPLAY_WIDTH>, \
-                        Chip8::Display::DISPLAY_HEIGHT>* frame =
-                                m_chip8.m_display->getDisplayFrame();
-
-    for (int row = 0; row < Chip8::Display::DISPLAY_HEIGHT; ++row)
+    // the color of an off pixel for every fading level
+    constexpr std::array<uint32_t, Chip8::Display::MAXIMAL_FADING_VALUE + 1> FADING_PALETTE {[]
     {
-        for (int column = 0; column < Chip8::Display::DISPLAY_WIDTH; ++column)
+        // the lightest grey we want to show has rgb code (125,125,125)
+        constexpr uint32_t LIGHTEST_GREY {125};
+
+        // the off pixel gets a color basing on the fading level
+        // we want the color to be given by the rgb code
+        // (colorShade,colorShade,colorShade), which is grey
+        constexpr uint32_t n = Chip8::Display::MAXIMAL_FADING_VALUE/LIGHTEST_GREY;
+
+        std::array<uint32_t, Chip8::Display::MAXIMAL_FADING_VALUE + 1> palette {};
+
+        for (uint32_t fadingLevel = 0; fadingLevel < palette.size(); ++fadingLevel)
         {
-            Chip8::Chip8::Pixel pixel = (*frame)[row][column];
+            const uint32_t colorShade = fadingLevel/n;
+            palette[fadingLevel] = rgba(colorShade, colorShade, colorShade);
+        }
 
-            if (pixel.m_status == Chip8::Chip8::Status::on)
-            {
-                // sets color to white for on pixels
-                SDL_SetRenderDrawColor(renderer, 255,255,255, 255);
+        return palette;
+    }()};
+}
 
-                // every chip8 pixel becomes a square of side 20
-                SDL_Rect pixelRectangle = SDL_Rect(20*column,20*row, 20,20);
-                SDL_RenderFillRect(renderer, & pixelRectangle);
-            }
-            else if (pixel.m_fadingLevel > 0)
-            {
-                // the lightest grey we want to show has rgb code (125,125,125)
-                constexpr int32_t LIGHTEST_GREY {125};
+bool Chip8Emulator::renderDisplay(SDL_Renderer* renderer, SDL_Texture* texture)
+{
+    // the last frame published by the chip8 starts the fading of the pixels it turned off
+    if (m_chip8.m_frameBuffer->acquire())
+    {
+        m_fadingPlane.update(m_chip8.m_frameBuffer->front());
+    }
 
-                // the off pixel gets a color basing on the fading level
-                // we want the color to be given by the rgb code
-                // (colorShade,colorShade,colorShade), which is grey
-                constexpr int32_t n = Chip8::Display::MAXIMAL_FADING_VALUE/LIGHTEST_GREY;
-                uint8_t colorShade = static_cast<uint8_t>(pixel.m_fadingLevel/n);
+    const Chip8::FrameBuffer::Frame& frame {m_chip8.m_frameBuffer->front()};
 
-                SDL_SetRenderDrawColor(renderer, colorShade,colorShade,colorShade, 255);
+    // the pixels fade at every tick of 60 Hz, independently of how often the window is drawn
+    const bool hasFaded {m_fadingPlane.decreaseFadingLevel(std::chrono::steady_clock::now())};
 
-                SDL_Rect pixelRectangle = SDL_Rect(20*column, 20*row, 20, 20);
-                SDL_RenderFillRect(renderer, & pixelRectangle);
-            }
+    // the frame changes only if the display changed or some pixel faded
+    if (!m_mustRedraw && !hasFaded && frame.m_generation == m_shownGeneration)
+    {
+        return false;
+    }
+
+    m_shownGeneration = frame.m_generation;
+    m_mustRedraw = false;
+
+    // the pixels of the chip8 are written in the texture, which has one texel per pixel
+    void* texels {nullptr};
+    int pitch {0};
+
+    if (SDL_LockTexture(texture, nullptr, &texels, &pitch) != 0)
+    {
+        std::cout << "The texture of the display could not be locked: " << SDL_GetError() << '\n';
+        return false;
+    }
+
+    for (int row = 0; row < Chip8::Display::DISPLAY_HEIGHT; ++row)
+    {
+        // the rows of the texture are pitch bytes apart
+        void* rowTexels {static_cast<uint8_t*>(texels) + row*pitch};
+        uint32_t* line {static_cast<uint32_t*>(rowTexels)};
+
+        for (int column = 0; column < Chip8::Display::DISPLAY_WIDTH; ++column)
+        {
+            const Chip8::Pixel pixel = m_fadingPlane.getPixel(frame, row, column);
+
+            line[column] = (pixel.m_status == Chip8::Status::on) ? WHITE : FADING_PALETTE[static_cast<size_t>(pixel.m_fadingLevel)];
         }
     }
+
+    SDL_UnlockTexture(texture);
+
+    // the texture is stretched to the whole window, so every chip8 pixel becomes a square of side 20
+    SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+
+    return true;
 }
 
 void Chip8Emulator::handleSystemEvents(SDL_Event ev)
@@ -163,11 +201,11 @@ void Chip8Emulator::handleSystemEvents(SDL_Event ev)
             // if the user closes the window
             case SDL_QUIT:
             {
-                std::unique_lock eventMutexLock {m_chip8.m_eventMutex};
                 std::unique_lock delayTimerMutexLock {m_chip8.m_delayTimerMutex};
                 std::unique_lock soundTimerMutexLock {m_chip8.m_soundTimerMutex};
                 m_chip8.m_isRunning = false;
-                m_chip8.m_eventHappened.notify_one();
+                // the instruction fx0a could be waiting for a key
+                m_chip8.m_keyboard->notify();
                 // we need to notify the delay and sound timer threads so that they can
                 // exit the function they are executing and be joined at the destructioin of Chip8
                 m_chip8.m_setDelayTimer.notify_one();
@@ -175,19 +213,35 @@ void Chip8Emulator::handleSystemEvents(SDL_Event ev)
                 break;
             }
 
-            case SDL_KEYDOWN:
+            case SDL_WINDOWEVENT:
             {
-                std::unique_lock eventMutexLock {m_chip8.m_eventMutex};
+                switch (ev.window.event)
+                {
+                case SDL_WINDOWEVENT_MINIMIZED:
+                    m_isMinimized = true;
+                    break;
+
+                // the content of the window could have been lost while it was minimized or covered
+                case SDL_WINDOWEVENT_RESTORED:
+                case SDL_WINDOWEVENT_EXPOSED:
+                    m_isMinimized = false;
+                    m_mustRedraw = true;
+                    break;
+
+                default:
+                    break;
+                }
+                break;
+            }
 
+            case SDL_KEYDOWN:
+            {
                 // no need to repeat the following if this is a repeated pressed key event of the same key
                 if (ev.key.repeat == 0)
                 {
                     uint8_t chip8PressedKey {getChip8Key(ev.key.keysym.scancode).value()};
 
-                    m_chip8.m_chip8Keys[chip8PressedKey] = true;
-                    m_chip8.m_lastPressedKey = chip8PressedKey;
-
-                    m_chip8.m_eventHappened.notify_one();
+                    m_chip8.m_keyboard->press(chip8PressedKey);
                 }
                 break;
             }
@@ -196,9 +250,7 @@ void Chip8Emulator::handleSystemEvents(SDL_Event ev)
             {
                 uint8_t releasedKey {getChip8Key(ev.key.keysym.scancode).value()};
 
-                std::unique_lock eventMutexLock {m_chip8.m_eventMutex};
-                m_chip8.m_chip8Keys[releasedKey] = false;
-                m_chip8.m_lastPressedKey = std::nullopt;
+                m_chip8.m_keyboard->release(releasedKey);
 
                 break;
             }
@@ -219,27 +271,84 @@ void Chip8Emulator::renderAndKeyboard(std::promise<bool>& promiseDisplayInitiali
                             SDL_WINDOWPOS_CENTERED,
                             1280, 640,
                             SDL_WINDOW_SHOWN)};
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, 0);
+    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_PRESENTVSYNC);
 
-    promiseDisplayInitialized.set_value(true);
+    // the frames of the chip8 are streamed to the renderer through this texture
+    SDL_Texture* texture {SDL_CreateTexture(
+                            renderer,
+                            SDL_PIXELFORMAT_RGBA8888,
+                            SDL_TEXTUREACCESS_STREAMING,
+                            Chip8::Display::DISPLAY_WIDTH, Chip8::Display::DISPLAY_HEIGHT)};
 
-    std::unique_lock displayLock {m_chip8.m_displayMutex};
-    displayLock.unlock();
+    promiseDisplayInitialized.set_value(true);
 
     SDL_Event ev;
     ev.type = 0;
 
+    // with vsync, SDL_RenderPresent waits for the refresh of the monitor
+    SDL_RendererInfo rendererInfo {};
+    const bool hasVsync {SDL_GetRendererInfo(renderer, &rendererInfo) == 0 &&
+                         (rendererInfo.flags & SDL_RENDERER_PRESENTVSYNC) != 0};
+
+    constexpr std::chrono::nanoseconds framePeriod {std::chrono::seconds(1)};
+    const std::chrono::nanoseconds minimalFramePeriod {framePeriod / MAXIMAL_FRAME_RATE};
+
+    auto nextFrame = std::chrono::steady_clock::now();
+
+    // with Scheduling::singleThread, the emulated time reached by the chip8
+    auto emulatedTime = std::chrono::steady_clock::now();
+
     while (m_chip8.m_isRunning)
     {
         handleSystemEvents(ev);
 
-        displayLock.lock();
-        renderDisplay(renderer);
-        displayLock.unlock();
+        // with a single thread, the frames of emulated time due until now are executed here, before showing them
+        if (m_scheduling == Chip8::Scheduling::singleThread)
+        {
+            const auto now = std::chrono::steady_clock::now();
 
-        SDL_RenderPresent(renderer);
+            // if this thread has been stuck for a while (for example while the window was dragged)
+            // the frames missed are dropped instead of being executed all at once
+            emulatedTime = std::max(emulatedTime, now - MAXIMAL_FRAMES_BEHIND * Chip8::FRAME_PERIOD);
+
+            const auto dueFrames = (now - emulatedTime) / Chip8::FRAME_PERIOD;
+
+            m_chip8.runFrames(static_cast<uint64_t>(dueFrames));
+            emulatedTime += dueFrames * Chip8::FRAME_PERIOD;
+        }
+
+        // while the window is minimized nothing is drawn: we just wait for an event restoring or closing it
+        // (or for the next frame, if the chip8 runs in this thread)
+        if (m_isMinimized)
+        {
+            SDL_WaitEventTimeout(nullptr, (m_scheduling == Chip8::Scheduling::singleThread) ? 1000 / MAXIMAL_FRAME_RATE : 100);
+            nextFrame = std::chrono::steady_clock::now();
+            continue;
+        }
+
+        // the frame is read from the frame buffer of the chip8, which never blocks the emulation thread
+        const bool hasRendered {renderDisplay(renderer, texture)};
+
+        if (hasRendered)
+        {
+            SDL_RenderPresent(renderer);
+        }
+
+        // the frames which are not presented (or presented without vsync) are paced by MAXIMAL_FRAME_RATE.
+        // The next frame is scheduled from the previous one, unless we are already late
+        if (!hasRendered || !hasVsync)
+        {
+            nextFrame = std::max(nextFrame + minimalFramePeriod, std::chrono::steady_clock::now());
+            std::this_thread::sleep_until(nextFrame);
+        }
+        else
+        {
+            nextFrame = std::chrono::steady_clock::now();
+        }
     }
 
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
 }
 
@@ -0,0 +1,128 @@
+#include <chip8.h>
+#include <algorithm>
+#include <bit>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CHIP8_FADING_SIMD
+#include <immintrin.h>
+#endif
+
+// The fading levels are 16-bit counters, so decreasing them is a saturating subtraction,
+// which the vector units do on 8 (SSE2) or 16 (AVX2) counters at once, without any branch.
+// SSE2 is always available on x86-64, while AVX2 is used only if the cpu running the emulator
+// supports it: the kernel is chosen once, the first time decreaseFadingLevel is called.
+namespace
+{
+    using Kernel = void (*)(uint16_t* fadingLevels, size_t size, uint16_t decrease);
+
+#ifdef CHIP8_FADING_SIMD
+
+    // the vectors are read and written unaligned so that no pointer cast raises the alignment,
+    // but the plane is aligned anyway, so the accesses never cross a cache line
+    void decreaseSse2(uint16_t* fadingLevels, const size_t size, const uint16_t decrease)
+    {
+        const __m128i decreases = _mm_set1_epi16(static_cast<short>(decrease));
+
+        for (size_t i = 0; i < size; i += 8)
+        {
+            void* address = fadingLevels + i;
+
+            const __m128i levels = _mm_loadu_si128(static_cast<const __m128i_u*>(address));
+            _mm_storeu_si128(static_cast<__m128i_u*>(address), _mm_subs_epu16(levels, decreases));
+        }
+    }
+
+    __attribute__((target("avx2")))
+    void decreaseAvx2(uint16_t* fadingLevels, const size_t size, const uint16_t decrease)
+    {
+        const __m256i decreases = _mm256_set1_epi16(static_cast<short>(decrease));
+
+        for (size_t i = 0; i < size; i += 16)
+        {
+            void* address = fadingLevels + i;
+
+            const __m256i levels = _mm256_loadu_si256(static_cast<const __m256i_u*>(address));
+            _mm256_storeu_si256(static_cast<__m256i_u*>(address), _mm256_subs_epu16(levels, decreases));
+        }
+    }
+
+#else
+
+    void decreaseScalar(uint16_t* fadingLevels, const size_t size, const uint16_t decrease)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            fadingLevels[i] = (fadingLevels[i] > decrease) ? static_cast<uint16_t>(fadingLevels[i] - decrease) : uint16_t {0};
+        }
+    }
+
+#endif
+
+    Kernel selectKernel()
+    {
+#ifdef CHIP8_FADING_SIMD
+        return __builtin_cpu_supports("avx2") ? &decreaseAvx2 : &decreaseSse2;
+#else
+        return &decreaseScalar;
+#endif
+    }
+}
+
+void Chip8::FadingPlane::update(const FrameBuffer::Frame& frame)
+{
+    if (frame.m_cleared)
+    {
+        m_fadingLevels = {};
+    }
+
+    if (m_maximalFading == 0)
+    {
+        return;
+    }
+
+    for (int row = 0; row < Display::DISPLAY_HEIGHT; ++row)
+    {
+        // the pixels turned off and then on again in the meantime don't fade
+        for (Display::Row pixels = frame.m_turnedOff[row] & ~frame.m_pixels[row]; pixels != 0; pixels &= pixels - 1)
+        {
+            const int column = Display::DISPLAY_WIDTH - 1 - std::countr_zero(pixels);
+            m_fadingLevels[row*Display::DISPLAY_WIDTH + column] = m_maximalFading;
+            m_fadingTicks = FADING_DURATION;
+        }
+    }
+}
+
+bool Chip8::FadingPlane::decreaseFadingLevel(const std::chrono::steady_clock::time_point now)
+{
+    // when no pixel is fading, there is nothing to decrease and the ticks start counting again from now
+    if (m_fadingTicks == 0)
+    {
+        m_lastTick = now;
+        return false;
+    }
+
+    const auto ticks = (now - m_lastTick) / FADING_TICK;
+
+    if (ticks <= 0)
+    {
+        return false;
+    }
+
+    m_lastTick += ticks * FADING_TICK;
+
+    // after m_fadingTicks ticks all the pixels are black, so the later ones don't matter
+    const uint16_t elapsedTicks = static_cast<uint16_t>(std::min<decltype(ticks)>(ticks, m_fadingTicks));
+    m_fadingTicks = static_cast<uint16_t>(m_fadingTicks - elapsedTicks);
+
+    // the initialization of a static local variable is thread safe
+    static const Kernel kernel {selectKernel()};
+
+    // the vector kernels process whole vectors of 16 counters
+    static_assert((Display::DISPLAY_WIDTH * Display::DISPLAY_HEIGHT) % 16 == 0);
+
+    // the levels are at most m_maximalFading, so the decrease fits in 16 bits
+    const uint16_t decrease = static_cast<uint16_t>(std::min(elapsedTicks * m_fadingStep, int {m_maximalFading}));
+    kernel(m_fadingLevels.data(), m_fadingLevels.size(), decrease);
+
+    return true;
+}
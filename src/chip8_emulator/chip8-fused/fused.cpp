@@ -0,0 +1,145 @@
+#include <chip8.h>
+#include <invalidation.h>
+#include <algorithm>
+
+// Some short sequences of instructions are very common in the roms:
+// - 6xkk, Fx15 sets the delay timer to a constant;
+// - Fx07, 3xkk, 1nnn waits for the delay timer to reach kk, jumping back to nnn until it does;
+// - Annn, Dxyn draws the sprite at address nnn.
+// The engine fused executes each of them with a single lookup, without fetching and dispatching
+// the instructions one by one. The behaviour is the same as executing the instructions separately,
+// since no other instruction (nor the display) can run in between them.
+void Chip8::fuseInstructions()
+{
+    Fusions& fusions {*m_fusions};
+
+    fusions.m_fusions = {};
+    fusions.m_statistics.m_loadDelayTimer.m_found = 0;
+    fusions.m_statistics.m_waitDelayTimer.m_found = 0;
+    fusions.m_statistics.m_loadIAndDraw.m_found = 0;
+
+    const std::array<Register, 4096>& ram {*m_ramPtr};
+
+    const auto instructionAt = [&ram](const size_t address)
+    {
+        return static_cast<uint16_t>((ram[address] << 8u) | ram[address+1]);
+    };
+
+    // the instructions of the rom start at 0x200, so they are at even addresses
+    for (size_t address = 0x200; address + 3 < ram.size(); address += 2)
+    {
+        const uint16_t first = instructionAt(address);
+        const uint16_t second = instructionAt(address + 2);
+
+        const uint8_t x = static_cast<uint8_t>((first & 0xf00) >> 8u);
+        const uint16_t sameX = static_cast<uint16_t>(first & 0xf00);
+
+        Fusions::Fusion& fusion {fusions.m_fusions[address]};
+
+        if ((first & 0xf000) == 0x6000 && second == (0xf015 | sameX))
+        {
+            fusion = {Fusions::Kind::loadDelayTimer, 2, x, static_cast<uint8_t>(first & 0xff), 0, nullptr};
+            ++fusions.m_statistics.m_loadDelayTimer.m_found;
+        }
+        else if ((first & 0xf0ff) == 0xf007 && (second & 0xff00) == (0x3000 | sameX) &&
+            address + 5 < ram.size() && (instructionAt(address + 4) & 0xf000) == 0x1000)
+        {
+            const uint16_t third = instructionAt(address + 4);
+
+            fusion = {Fusions::Kind::waitDelayTimer, 3, x, static_cast<uint8_t>(second & 0xff),
+                static_cast<uint16_t>(third & 0xfff), nullptr};
+            ++fusions.m_statistics.m_waitDelayTimer.m_found;
+        }
+        else if ((first & 0xf000) == 0xa000 && (second & 0xf000) == 0xd000)
+        {
+            fusion = {Fusions::Kind::loadIAndDraw, 2, 0, 0, static_cast<uint16_t>(first & 0xfff),
+                &(*m_dispatchTable)[second]};
+            ++fusions.m_statistics.m_loadIAndDraw.m_found;
+        }
+    }
+}
+
+void Chip8::runFused(uint64_t count)
+{
+    Fusions& fusions {*m_fusions};
+    FusionStatistics& statistics {fusions.m_statistics};
+
+    while (count > 0)
+    {
+        const Address pc = m_PC;
+
+        // a fusion is executed only if all its instructions fit in count
+        const Fusions::Fusion* fusion = (pc < fusions.m_fusions.size()) ? &fusions.m_fusions[pc] : nullptr;
+
+        if (fusion == nullptr || fusion->m_kind == Fusions::Kind::none || fusion->m_length > count)
+        {
+            step();
+            --count;
+            ++statistics.m_interpretedInstructions;
+            continue;
+        }
+
+        uint64_t numInstructions = fusion->m_length;
+
+        switch (fusion->m_kind)
+        {
+        case Fusions::Kind::loadDelayTimer:
+            ld(fusion->m_x, fusion->m_kk);
+            ldDTVx(fusion->m_x);
+            m_PC = static_cast<Address>(pc + 4);
+            ++statistics.m_loadDelayTimer.m_fired;
+            break;
+
+        case Fusions::Kind::waitDelayTimer:
+            ldVxDT(fusion->m_x);
+
+            if (m_registers[fusion->m_x] == fusion->m_kk)
+            {
+                // the jump is skipped
+                m_PC = static_cast<Address>(pc + 6);
+                numInstructions = 2;
+            }
+            else
+            {
+                jp(fusion->m_nnn);
+            }
+
+            ++statistics.m_waitDelayTimer.m_fired;
+            break;
+
+        case Fusions::Kind::loadIAndDraw:
+            ldI(fusion->m_nnn);
+            m_PC = static_cast<Address>(pc + 2);
+            fusion->m_last->m_handler(*this, *fusion->m_last);
+            ++statistics.m_loadIAndDraw.m_fired;
+            break;
+
+        case Fusions::Kind::none:
+            break;
+        }
+
+        count -= numInstructions;
+        statistics.m_fusedInstructions += numInstructions;
+    }
+}
+
+// there is no bitset of the bytes fused, so the fusions near the bytes written are always looked at
+void Chip8::Fusions::invalidate(const Address first, const Address last)
+{
+    discardOverlappingCode(first, last, m_fusions.size(), MAXIMAL_FUSION_LENGTH,
+        [this](const size_t start)
+        {
+            const Fusion& fusion {m_fusions[start]};
+            return (fusion.m_kind != Kind::none) ? size_t {fusion.m_length} : 0;
+        },
+        [this](const size_t start)
+        {
+            m_fusions[start].m_kind = Kind::none;
+            ++m_statistics.m_invalidations;
+        });
+}
+
+Chip8::FusionStatistics Chip8::getFusionStatistics() const
+{
+    return m_fusions ? m_fusions->m_statistics : FusionStatistics {};
+}
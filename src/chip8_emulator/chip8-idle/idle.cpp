@@ -0,0 +1,151 @@
+#include <chip8.h>
+
+// The loop
+//     start:     Fx07        (Vx = delay timer)
+//     start + 2: 3xkk        (skips the jump if Vx == kk)
+//     start + 4: 1nnn        (jumps back to start, nnn == start)
+// only reads the delay timer and writes Vx. With TimerMode::lazy the delay timer doesn't change
+// between two ticks, so if it is not kk the loop keeps going around until the next tick,
+// and executing its instructions one by one can only move the program counter around the loop.
+// The callers of executeInstructions never ask for more instructions than fit before the next tick
+// (run and runFrames execute the frame before ticking the timers, runTurbo stops at every tick),
+// so when the rom is in such a loop the count instructions can be skipped: the program counter is moved
+// where it would have been after executing them, and Vx gets the value of the delay timer.
+std::optional<Chip8::IdleLoop> Chip8::findIdleLoop() const
+{
+    if (!m_skipIdleLoops || m_timerMode != TimerMode::lazy)
+    {
+        return std::nullopt;
+    }
+
+    const std::array<Register, 4096>& ram {*m_ramPtr};
+
+    const auto instructionAt = [&ram](const size_t address)
+    {
+        return static_cast<uint16_t>((ram[address] << 8u) | ram[address+1]);
+    };
+
+    if (m_PC + 1u >= ram.size())
+    {
+        return std::nullopt;
+    }
+
+    // the position of the program counter in the loop is given by the instruction it points to
+    size_t position {0};
+
+    switch (instructionAt(m_PC) & 0xf000)
+    {
+    case 0xf000:
+        position = 0;
+        break;
+
+    case 0x3000:
+        position = 1;
+        break;
+
+    case 0x1000:
+        position = 2;
+        break;
+
+    default:
+        return std::nullopt;
+    }
+
+    if (m_PC < 2*position)
+    {
+        return std::nullopt;
+    }
+
+    const size_t start {m_PC - 2*position};
+
+    if (start + 5 >= ram.size())
+    {
+        return std::nullopt;
+    }
+
+    const uint16_t first {instructionAt(start)};
+    const uint16_t second {instructionAt(start + 2)};
+    const uint16_t third {instructionAt(start + 4)};
+
+    if ((first & 0xf0ff) != 0xf007 || (second & 0xff00) != (0x3000 | (first & 0xf00)) || third != (0x1000 | start))
+    {
+        return std::nullopt;
+    }
+
+    const uint8_t x {static_cast<uint8_t>((first & 0xf00) >> 8u)};
+    const Register kk {static_cast<Register>(second & 0xff)};
+
+    // the loop ends as soon as it reads kk from the delay timer
+    if (m_lazyDelayTimer.valueAt(currentTick()) == kk)
+    {
+        return std::nullopt;
+    }
+
+    // at 3xkk, Vx has been read from the delay timer before, maybe at a previous tick
+    if (position == 1 && m_registers[x] == kk)
+    {
+        return std::nullopt;
+    }
+
+    return IdleLoop {static_cast<Address>(start), x, position};
+}
+
+bool Chip8::skipIdleLoop(const uint64_t count)
+{
+    if (count == 0)
+    {
+        return false;
+    }
+
+    // dxyn waiting for the vertical blank is executed again and again until the next tick,
+    // without changing anything
+    if (m_vblankTick != 0 && m_skipIdleLoops && currentTick() < m_vblankTick)
+    {
+        ++m_idleStatistics.m_idleLoops;
+        m_idleStatistics.m_skippedInstructions += count;
+
+        return true;
+    }
+
+    const std::optional<IdleLoop> loop {findIdleLoop()};
+
+    if (!loop.has_value())
+    {
+        return false;
+    }
+
+    // Vx is written only if Fx07 is among the instructions skipped
+    if (loop->m_position == 0 || loop->m_position + count > 3)
+    {
+        m_registers[loop->m_x] = m_lazyDelayTimer.valueAt(currentTick());
+    }
+
+    m_PC = static_cast<Address>(loop->m_start + 2*((loop->m_position + count) % 3));
+
+    ++m_idleStatistics.m_idleLoops;
+    m_idleStatistics.m_skippedInstructions += count;
+
+    return true;
+}
+
+// The vertical blank of the COSMAC VIP happened at every tick of its timers: a sprite can be drawn
+// at the first tick after dxyn has been reached. In the meantime the program counter stays at dxyn
+// (which is executed again), so m_vblankTick always belongs to the instruction at the program counter
+bool Chip8::reachedVBlank()
+{
+    const uint64_t tick {currentTick()};
+
+    if (m_vblankTick == 0)
+    {
+        m_vblankTick = tick + 1;
+        return false;
+    }
+
+    if (tick < m_vblankTick)
+    {
+        return false;
+    }
+
+    m_vblankTick = 0;
+    return true;
+}
@@ -0,0 +1,467 @@
+#include <chip8.h>
+#include <invalidation.h>
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+
+#if defined(CHIP8_JIT) && defined(__x86_64__) && defined(__linux__)
+#define CHIP8_JIT_AVAILABLE
+#include <sys/mman.h>
+#endif
+
+// The compiled blocks follow the System V calling convention:
+// rdi points to the registers V0..VF, rsi to the register I and edx is the number of instructions to execute.
+// During the block I is kept in r8 and the number of instructions in r9,
+// while the registers V0..VF are read and written directly in m_registers
+// (they are addressed as [rdi + x], so every access is a single instruction hitting the L1 cache).
+// The program counter is not kept anywhere: every instruction of the block has a known address,
+// so the block returns in eax the address of the first instruction it didn't execute
+// (or the target of its final jump or skip).
+// Before every instruction but the first one, the block checks whether it must stop there,
+// so that the caller can execute exactly as many instructions as it wants:
+// the timers and the display must see the same instruction counts as with the other engines.
+namespace
+{
+    using Address = uint16_t;
+
+    // upper bound of the bytes of native code emitted for one instruction of a block
+    // (including the check before it), and of the prologue and epilogue of the block
+    constexpr size_t MAXIMAL_INSTRUCTION_CODE {48};
+    constexpr size_t MAXIMAL_BLOCK_CODE {Chip8::Jit::MAXIMAL_BLOCK_LENGTH * MAXIMAL_INSTRUCTION_CODE + 64};
+
+    // the compiled blocks are aligned to 16 bytes, as the functions generated by the compilers
+    constexpr size_t BLOCK_ALIGNMENT {16};
+
+    // the instructions that are translated into native code
+    bool isCompilable(const uint16_t instruction)
+    {
+        const uint16_t nibble = instruction >> 12u;
+        const uint16_t n = instruction & 0xf;
+        const uint16_t kk = instruction & 0xff;
+
+        switch (nibble)
+        {
+        case 0x1: case 0x3: case 0x4: case 0x5: case 0x6: case 0x7: case 0xa:
+            return true;
+
+        case 0x8:
+            // 8xy6 and 8xye depend on the instruction set and are left to the interpreter
+            return n <= 5 || n == 7;
+
+        case 0x9:
+            return n == 0;
+
+        case 0xf:
+            return kk == 0x1e || kk == 0x29;
+
+        default:
+            return false;
+        }
+    }
+
+    // the instructions after which the program counter can be anything else than the next instruction
+    bool endsCompiledBlock(const uint16_t instruction)
+    {
+        const uint16_t nibble = instruction >> 12u;
+
+        return nibble == 0x1 || nibble == 0x3 || nibble == 0x4 || nibble == 0x5 || nibble == 0x9;
+    }
+
+    class Emitter {
+    public:
+        explicit Emitter(uint8_t* code) : m_code {code} {}
+
+        void emit(std::initializer_list<uint8_t> bytes)
+        {
+            for (uint8_t byte : bytes)
+            {
+                m_code[m_size] = byte;
+                ++m_size;
+            }
+        }
+
+        void emit32(const uint32_t value)
+        {
+            std::memcpy(&m_code[m_size], &value, sizeof(value));
+            m_size += sizeof(value);
+        }
+
+        // mov eax, value
+        void movEax(const Address value) { emit({0xb8}); emit32(value); }
+
+        // mov ecx, value
+        void movEcx(const Address value) { emit({0xb9}); emit32(value); }
+
+        // mov [rsi], r8w; ret
+        void epilogue() { emit({0x66, 0x44, 0x89, 0x06, 0xc3}); }
+
+        size_t size() const { return m_size; }
+
+    private:
+        uint8_t* m_code;
+        size_t m_size {0};
+    };
+
+    // translates the instruction at address pc, which must be compilable
+    void emitInstruction(Emitter& e, const uint16_t instruction, const Address pc)
+    {
+        const uint8_t x = static_cast<uint8_t>((instruction & 0xf00) >> 8u);
+        const uint8_t y = static_cast<uint8_t>((instruction & 0xf0) >> 4u);
+        const uint8_t kk = static_cast<uint8_t>(instruction & 0xff);
+        const uint8_t n = static_cast<uint8_t>(instruction & 0xf);
+        const uint16_t nnn = instruction & 0xfff;
+
+        const Address next = static_cast<Address>(pc + 2);
+        const Address skip = static_cast<Address>(pc + 4);
+
+        switch (instruction >> 12u)
+        {
+        case 0x1:
+            e.movEax(nnn);
+            break;
+
+        // the skips load both the possible values of the program counter and choose with a cmov
+        case 0x3:
+            e.movEax(next);
+            e.movEcx(skip);
+            e.emit({0x80, 0x7f, x, kk}); // cmp byte [rdi + x], kk
+            e.emit({0x0f, 0x44, 0xc1}); // cmove eax, ecx
+            break;
+
+        case 0x4:
+            e.movEax(next);
+            e.movEcx(skip);
+            e.emit({0x80, 0x7f, x, kk}); // cmp byte [rdi + x], kk
+            e.emit({0x0f, 0x45, 0xc1}); // cmovne eax, ecx
+            break;
+
+        case 0x5:
+            e.movEax(next);
+            e.movEcx(skip);
+            e.emit({0x8a, 0x57, x}); // mov dl, [rdi + x]
+            e.emit({0x3a, 0x57, y}); // cmp dl, [rdi + y]
+            e.emit({0x0f, 0x44, 0xc1}); // cmove eax, ecx
+            break;
+
+        case 0x9:
+            e.movEax(next);
+            e.movEcx(skip);
+            e.emit({0x8a, 0x57, x}); // mov dl, [rdi + x]
+            e.emit({0x3a, 0x57, y}); // cmp dl, [rdi + y]
+            e.emit({0x0f, 0x45, 0xc1}); // cmovne eax, ecx
+            break;
+
+        case 0x6:
+            e.emit({0xc6, 0x47, x, kk}); // mov byte [rdi + x], kk
+            break;
+
+        case 0x7:
+            e.emit({0x80, 0x47, x, kk}); // add byte [rdi + x], kk
+            break;
+
+        case 0x8:
+            switch (n)
+            {
+            case 0x0:
+                e.emit({0x8a, 0x47, y}); // mov al, [rdi + y]
+                e.emit({0x88, 0x47, x}); // mov [rdi + x], al
+                break;
+
+            case 0x1:
+                e.emit({0x8a, 0x47, y}); // mov al, [rdi + y]
+                e.emit({0x08, 0x47, x}); // or [rdi + x], al
+                break;
+
+            case 0x2:
+                e.emit({0x8a, 0x47, y}); // mov al, [rdi + y]
+                e.emit({0x20, 0x47, x}); // and [rdi + x], al
+                break;
+
+            case 0x3:
+                e.emit({0x8a, 0x47, y}); // mov al, [rdi + y]
+                e.emit({0x30, 0x47, x}); // xor [rdi + x], al
+                break;
+
+            // VF is written last, as in Chip8::addVxVy, Chip8::sub and Chip8::subn
+            case 0x4:
+                if (x != y)
+                {
+                    e.emit({0x8a, 0x47, x}); // mov al, [rdi + x]
+                    e.emit({0x02, 0x47, y}); // add al, [rdi + y]
+                    e.emit({0x0f, 0x92, 0xc2}); // setc dl
+                    e.emit({0x88, 0x47, x}); // mov [rdi + x], al
+                    e.emit({0x88, 0x57, 0x0f}); // mov [rdi + 15], dl
+                }
+                else
+                {
+                    // Chip8::addVxVy compares Vx with itself after the addition, so VF is always 0
+                    e.emit({0x8a, 0x47, x}); // mov al, [rdi + x]
+                    e.emit({0x00, 0xc0}); // add al, al
+                    e.emit({0x88, 0x47, x}); // mov [rdi + x], al
+                    e.emit({0xc6, 0x47, 0x0f, 0x00}); // mov byte [rdi + 15], 0
+                }
+                break;
+
+            case 0x5:
+                e.emit({0x8a, 0x47, x}); // mov al, [rdi + x]
+                e.emit({0x8a, 0x4f, y}); // mov cl, [rdi + y]
+                e.emit({0x38, 0xc8}); // cmp al, cl
+                e.emit({0x0f, 0x93, 0xc2}); // setae dl
+                e.emit({0x28, 0xc8}); // sub al, cl
+                e.emit({0x88, 0x47, x}); // mov [rdi + x], al
+                e.emit({0x88, 0x57, 0x0f}); // mov [rdi + 15], dl
+                break;
+
+            case 0x7:
+                e.emit({0x8a, 0x47, x}); // mov al, [rdi + x]
+                e.emit({0x8a, 0x4f, y}); // mov cl, [rdi + y]
+                e.emit({0x38, 0xc1}); // cmp cl, al
+                e.emit({0x0f, 0x97, 0xc2}); // seta dl
+                e.emit({0x28, 0xc1}); // sub cl, al
+                e.emit({0x88, 0x4f, x}); // mov [rdi + x], cl
+                e.emit({0x88, 0x57, 0x0f}); // mov [rdi + 15], dl
+                break;
+
+            default:
+                break;
+            }
+            break;
+
+        case 0xa:
+            e.emit({0x41, 0xb8}); // mov r8d, nnn
+            e.emit32(nnn);
+            break;
+
+        case 0xf:
+            e.emit({0x0f, 0xb6, 0x47, x}); // movzx eax, byte [rdi + x]
+
+            if (kk == 0x1e)
+            {
+                e.emit({0x66, 0x41, 0x01, 0xc0}); // add r8w, ax
+            }
+            else
+            {
+                e.emit({0x8d, 0x04, 0x80}); // lea eax, [rax + 4*rax]
+                e.emit({0x41, 0x89, 0xc0}); // mov r8d, eax
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    // translates the block and returns the number of bytes of native code written in code
+    size_t emitBlock(uint8_t* code, const uint16_t* instructions, const uint8_t length, const Address pc)
+    {
+        Emitter e {code};
+
+        e.emit({0x44, 0x0f, 0xb7, 0x06}); // movzx r8d, word [rsi]
+        e.emit({0x41, 0x89, 0xd1}); // mov r9d, edx
+
+        for (uint8_t i = 0; i < length; ++i)
+        {
+            const Address address = static_cast<Address>(pc + 2*i);
+
+            if (i != 0)
+            {
+                e.emit({0x41, 0x83, 0xf9, i}); // cmp r9d, i
+                e.emit({0x77, 0x0a}); // ja over the exit
+                e.movEax(address);
+                e.epilogue();
+            }
+
+            emitInstruction(e, instructions[i], address);
+        }
+
+        // if the block doesn't end with a jump or a skip, the program counter points after the block
+        if (!endsCompiledBlock(instructions[length - 1]))
+        {
+            e.movEax(static_cast<Address>(pc + 2*length));
+        }
+
+        e.epilogue();
+
+        return e.size();
+    }
+
+#ifdef CHIP8_JIT_AVAILABLE
+    uint8_t* allocateCode(const size_t size)
+    {
+        void* code = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        return (code != MAP_FAILED) ? static_cast<uint8_t*>(code) : nullptr;
+    }
+
+    void freeCode(uint8_t* code, const size_t size)
+    {
+        munmap(code, size);
+    }
+
+    // the buffer is never writable and executable at the same time
+    void setWritable(uint8_t* code, const size_t size, const bool writable)
+    {
+        mprotect(code, size, writable ? (PROT_READ | PROT_WRITE) : (PROT_READ | PROT_EXEC));
+    }
+#else
+    // without the jit there is no buffer, so no block is ever compiled
+    uint8_t* allocateCode(const size_t) { return nullptr; }
+    void freeCode(uint8_t*, const size_t) {}
+    void setWritable(uint8_t*, const size_t, const bool) {}
+#endif
+}
+
+Chip8::Jit::Jit() :
+    m_code {allocateCode(CODE_SIZE)}
+{}
+
+Chip8::Jit::~Jit()
+{
+    if (m_code != nullptr)
+    {
+        freeCode(m_code, CODE_SIZE);
+    }
+}
+
+bool Chip8::Jit::compile(const std::array<Register, 4096>& ram, const Address pc)
+{
+    Block& block {m_blocks[pc]};
+
+    std::array<uint16_t, MAXIMAL_BLOCK_LENGTH> instructions {};
+    uint8_t length = 0;
+    Address address = pc;
+
+    while (m_code != nullptr && length < MAXIMAL_BLOCK_LENGTH && address < ram.size() - 1)
+    {
+        const uint16_t instruction = static_cast<uint16_t>((ram[address] << 8u) | ram[address+1]);
+
+        if (!isCompilable(instruction))
+        {
+            break;
+        }
+
+        instructions[length] = instruction;
+        ++length;
+        address = static_cast<Address>(address + 2);
+
+        if (endsCompiledBlock(instruction))
+        {
+            break;
+        }
+    }
+
+    if (length == 0)
+    {
+        // the address is marked as code anyway, so that the program can make it compilable overwriting it
+        block = {nullptr, 1, NOT_COMPILABLE};
+        m_isCode[pc] = true;
+        m_isCode[pc+1] = true;
+
+        return false;
+    }
+
+    if (CODE_SIZE - m_codeUsed < MAXIMAL_BLOCK_CODE)
+    {
+        flush();
+    }
+
+    uint8_t* code = m_code + m_codeUsed;
+
+    setWritable(m_code, CODE_SIZE, true);
+    const size_t size = emitBlock(code, instructions.data(), length, pc);
+    setWritable(m_code, CODE_SIZE, false);
+
+    m_codeUsed += (size + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+
+    block = {reinterpret_cast<Function>(code), length, 0};
+
+    for (size_t byte = pc; byte < address; ++byte)
+    {
+        m_isCode[byte] = true;
+    }
+
+    ++m_statistics.m_compiledBlocks;
+
+    return true;
+}
+
+// the addresses marked as NOT_COMPILABLE are discarded too, so that they are looked at again
+void Chip8::Jit::invalidate(const Address first, const Address last)
+{
+    const auto lengthAt = [this](const size_t start)
+    {
+        const Block& block {m_blocks[start]};
+
+        return (block.m_function != nullptr || block.m_hotness == NOT_COMPILABLE) ? size_t {block.m_length} : 0;
+    };
+
+    discardOverlappingCode(m_isCode, first, last, MAXIMAL_BLOCK_LENGTH, lengthAt, [this](const size_t start)
+    {
+        Block& block {m_blocks[start]};
+
+        if (block.m_function != nullptr)
+        {
+            ++m_statistics.m_invalidations;
+        }
+
+        // the native code stays in the buffer until the next flush
+        block = {};
+    });
+}
+
+void Chip8::Jit::flush()
+{
+    m_blocks = {};
+    m_isCode.reset();
+    m_codeUsed = 0;
+
+    ++m_statistics.m_flushes;
+}
+
+// The interpreter executes the instructions until it reaches the start of a compiled block:
+// then the block executes as many of its instructions as the budget allows.
+void Chip8::runJit(uint64_t count)
+{
+    Jit& jit {*m_jit};
+
+    while (count > 0)
+    {
+        const Address pc = m_PC;
+
+        // the last address of the ram can't contain a whole instruction
+        if (pc < jit.m_blocks.size() - 1)
+        {
+            Jit::Block& block {jit.m_blocks[pc]};
+
+            if (block.m_function == nullptr && block.m_hotness != Jit::NOT_COMPILABLE)
+            {
+                ++block.m_hotness;
+
+                if (block.m_hotness == Jit::HOTNESS_THRESHOLD)
+                {
+                    jit.compile(*m_ramPtr, pc);
+                }
+            }
+
+            if (block.m_function != nullptr)
+            {
+                const uint32_t numInstructions = static_cast<uint32_t>(std::min<uint64_t>(block.m_length, count));
+
+                m_PC = block.m_function(m_registers.data(), &m_I, numInstructions);
+
+                count -= numInstructions;
+                jit.m_statistics.m_nativeInstructions += numInstructions;
+                continue;
+            }
+        }
+
+        step();
+        --count;
+        ++jit.m_statistics.m_interpretedInstructions;
+    }
+}
+
+Chip8::JitStatistics Chip8::getJitStatistics() const
+{
+    return m_jit ? m_jit->m_statistics : JitStatistics {};
+}
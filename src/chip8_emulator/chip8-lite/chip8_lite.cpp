@@ -0,0 +1,337 @@
+#include "chip8_lite.h"
+#include <chip8.h>
+#include <instructions.h>
+#include <read_from_file.h>
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstring>
+
+// The ram addresses are always reduced modulo the size of the ram,
+// so that a wrong rom can't make the instance read or write outside of its own state.
+namespace
+{
+    constexpr uint16_t RAM_MASK {0xfff};
+    constexpr uint16_t PROGRAM_START {0x200};
+}
+
+struct Chip8Lite::Machine
+{
+    Chip8Lite& m_lite;
+
+    std::array<uint8_t, 16>& registers() const { return m_lite.m_state.m_registers; }
+    uint16_t& I() const { return m_lite.m_state.m_I; }
+    uint16_t& PC() const { return m_lite.m_state.m_PC; }
+    uint8_t& SP() const { return m_lite.m_state.m_SP; }
+
+    uint16_t& stack(uint8_t sp) const { return m_lite.m_state.m_stack[sp & 0xf]; }
+    uint8_t& ram(size_t address) const { return m_lite.m_state.m_ram[address & RAM_MASK]; }
+
+    // there is no decoded nor compiled code to discard
+    void ramWritten(size_t, size_t) const {}
+
+    bool isPressed(uint8_t key) const { return key < 16 && ((m_lite.m_state.m_keys >> key) & 1u); }
+
+    bool draw(uint8_t x, uint8_t y, uint8_t n, bool wrap) const { return m_lite.draw(x, y, n, wrap); }
+};
+
+Chip8Lite::Chip8Lite(std::string_view flagChip8Type, std::string_view flagDrawInstruction, uint32_t randomSeed) :
+    m_state {}
+{
+    m_state.m_instructionSet = (flagChip8Type == "-s") ? InstructionSet::schip8 : InstructionSet::chip8;
+    m_state.m_drawBehaviour = (flagDrawInstruction == "-w") ? DrawBehaviour::wrap : DrawBehaviour::clip;
+    m_state.m_PC = PROGRAM_START;
+    m_state.m_lastPressedKey = NO_KEY;
+
+    // the xorshift generator must never have state zero
+    m_state.m_randomState = (randomSeed != 0) ? randomSeed : 1;
+
+    // the first addresses of the ram are used for the hexadecimal sprites, as in Chip8
+    size_t ramIndex = 0;
+    for (const std::array<uint8_t, 5>& hexadecimalSprite : Chip8::m_hexadecimalSprites)
+    {
+        for (uint8_t line : hexadecimalSprite)
+        {
+            m_state.m_ram[ramIndex] = line;
+            ++ramIndex;
+        }
+    }
+}
+
+void Chip8Lite::readFromFile(const std::filesystem::path& path)
+{
+    // as in loadProgram, only the part of the program that fits in the ram after the address 0x200 is copied
+    copyFromBinaryFile(path, reinterpret_cast<char*>(&m_state.m_ram[PROGRAM_START]), m_state.m_ram.size() - PROGRAM_START);
+}
+
+void Chip8Lite::loadProgram(std::span<const uint8_t> program)
+{
+    size_t length = std::min(program.size(), m_state.m_ram.size() - PROGRAM_START);
+
+    std::memcpy(&m_state.m_ram[PROGRAM_START], program.data(), length);
+}
+
+void Chip8Lite::step()
+{
+    uint16_t byte1 = static_cast<uint16_t>(m_state.m_ram[m_state.m_PC & RAM_MASK] << 8u);
+    uint16_t byte2 = m_state.m_ram[(m_state.m_PC + 1) & RAM_MASK];
+
+    execute(static_cast<uint16_t>(byte1 | byte2));
+}
+
+void Chip8Lite::run(uint64_t numInstructions)
+{
+    for (uint64_t i = 0; i < numInstructions; ++i)
+    {
+        step();
+    }
+}
+
+void Chip8Lite::advanceTime(std::chrono::nanoseconds elapsed)
+{
+    m_state.m_timerRemainder += elapsed;
+
+    while (m_state.m_timerRemainder >= TIMER_PERIOD)
+    {
+        m_state.m_timerRemainder -= TIMER_PERIOD;
+        tickTimers();
+    }
+}
+
+void Chip8Lite::tickTimers()
+{
+    if (m_state.m_delayTimer != 0)
+    {
+        --m_state.m_delayTimer;
+    }
+
+    if (m_state.m_soundTimer != 0)
+    {
+        --m_state.m_soundTimer;
+    }
+}
+
+void Chip8Lite::setKey(uint8_t key, bool pressed)
+{
+    assert(key < 16);
+
+    uint16_t bit = static_cast<uint16_t>(1u << key);
+
+    if (pressed)
+    {
+        m_state.m_keys = static_cast<uint16_t>(m_state.m_keys | bit);
+        m_state.m_lastPressedKey = key;
+    }
+    else
+    {
+        m_state.m_keys = static_cast<uint16_t>(m_state.m_keys & ~bit);
+        m_state.m_lastPressedKey = NO_KEY;
+    }
+}
+
+// xorshift32: it is not a good generator, but it is enough for chip8 games,
+// and its state fits in 4 bytes of the instance
+uint8_t Chip8Lite::random()
+{
+    uint32_t r = m_state.m_randomState;
+    r ^= r << 13u;
+    r ^= r >> 17u;
+    r ^= r << 5u;
+    m_state.m_randomState = r;
+
+    return static_cast<uint8_t>(r >> 24u);
+}
+
+bool Chip8Lite::draw(uint8_t x, uint8_t y, uint8_t n, bool wrap)
+{
+    // the sprite can be maximum 16 lines long by the chip8 documentation
+    assert(n < 16);
+
+    bool pixelWasUnset = false;
+
+    for (int offset = 0; offset < n; ++offset)
+    {
+        int row = y + offset;
+
+        // the byte of the sprite is moved to the leftmost columns of the row
+        uint64_t spriteRow = static_cast<uint64_t>(m_state.m_ram[(m_state.m_I + offset) & RAM_MASK]) << 56u;
+
+        if (!wrap)
+        {
+            if (row >= DISPLAY_HEIGHT)
+            {
+                break;
+            }
+
+            // the pixels shifted over the end of the row are clipped
+            spriteRow >>= x;
+        }
+        else
+        {
+            row %= DISPLAY_HEIGHT;
+            spriteRow = std::rotr(spriteRow, x);
+        }
+
+        pixelWasUnset = pixelWasUnset || ((m_state.m_frame[row] & spriteRow) != 0);
+        m_state.m_frame[row] ^= spriteRow;
+    }
+
+    return pixelWasUnset;
+}
+
+// The instructions are decoded as in Chip8::execute, including the cases in which the program counter
+// is not incremented, and executed by the same functions of instructions.h.
+void Chip8Lite::execute(uint16_t instruction)
+{
+    const Machine m {*this};
+    std::array<uint8_t, 16>& V = m_state.m_registers;
+
+    const bool schip8 = m_state.m_instructionSet == InstructionSet::schip8;
+    const bool wrap = m_state.m_drawBehaviour == DrawBehaviour::wrap;
+
+    uint8_t x = (instruction & 0xf00) >> 8u;
+    uint8_t y = (instruction & 0xf0) >> 4u;
+    uint8_t n = instruction & 0xf;
+    uint8_t kk = static_cast<uint8_t>(instruction & 0xff);
+    uint16_t nnn = instruction & 0xfff;
+
+    switch (instruction >> 12u)
+    {
+    case 0:
+        if (instruction == 0x00e0)
+        {
+            m_state.m_frame = {};
+        }
+        else if (instruction == 0x00ee)
+        {
+            instructions::ret(m);
+        }
+        break;
+
+    case 1:
+        instructions::jp(m, nnn);
+        return;
+
+    case 2:
+        instructions::call(m, nnn);
+        return;
+
+    case 3:
+        instructions::se(m, x, kk);
+        break;
+
+    case 4:
+        instructions::sne(m, x, kk);
+        break;
+
+    case 5:
+        instructions::seVxVy(m, x, y);
+        break;
+
+    case 6:
+        instructions::ld(m, x, kk);
+        break;
+
+    case 7:
+        instructions::add(m, x, kk);
+        break;
+
+    case 8:
+        switch (n)
+        {
+        case 0: instructions::ldVxVy(m, x, y); break;
+        case 1: instructions::bitOr(m, x, y); break;
+        case 2: instructions::bitAnd(m, x, y); break;
+        case 3: instructions::bitXor(m, x, y); break;
+        case 4: instructions::addVxVy(m, x, y); break;
+        case 5: instructions::sub(m, x, y); break;
+        case 6: instructions::shr(m, x, y, schip8); break;
+        case 7: instructions::subn(m, x, y); break;
+        case 0xe: instructions::shl(m, x, y, schip8); break;
+        default: return;
+        }
+        break;
+
+    case 9:
+        if (n != 0)
+        {
+            return;
+        }
+        instructions::sneVxVy(m, x, y);
+        break;
+
+    case 0xa:
+        instructions::ldI(m, nnn);
+        break;
+
+    case 0xb:
+        instructions::jpV0(m, nnn);
+        return;
+
+    case 0xc:
+        instructions::rnd(m, x, kk, random());
+        break;
+
+    case 0xd:
+        instructions::drw(m, x, y, n, wrap);
+        break;
+
+    case 0xe:
+        if (kk == 0x9e)
+        {
+            instructions::skp(m, x);
+        }
+        else if (kk == 0xa1)
+        {
+            instructions::sknp(m, x);
+        }
+        else
+        {
+            return;
+        }
+        break;
+
+    case 0xf:
+        switch (kk)
+        {
+        case 0x07:
+            V[x] = m_state.m_delayTimer;
+            break;
+
+        case 0x0a:
+            // there is no thread to put to sleep: if no key has been pressed yet,
+            // the program counter doesn't move and the instruction is executed again
+            if (m_state.m_lastPressedKey == NO_KEY)
+            {
+                return;
+            }
+
+            V[x] = m_state.m_lastPressedKey;
+            m_state.m_lastPressedKey = NO_KEY;
+            break;
+
+        case 0x15:
+            m_state.m_delayTimer = V[x];
+            break;
+
+        case 0x18:
+            m_state.m_soundTimer = V[x];
+            break;
+
+        case 0x1e: instructions::addI(m, x); break;
+        case 0x29: instructions::ldFVx(m, x); break;
+        case 0x33: instructions::ldB(m, x); break;
+        case 0x55: instructions::ldIVx(m, x, schip8); break;
+        case 0x65: instructions::ldVxI(m, x, schip8); break;
+
+        default:
+            break;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    m_state.m_PC = static_cast<uint16_t>(m_state.m_PC + 2);
+}
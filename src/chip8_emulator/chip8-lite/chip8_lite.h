@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string_view>
+
+/*
+    The class Chip8Lite is a chip8 meant to be hosted in large numbers by the same process.
+    Unlike Chip8, it doesn't own any thread nor any synchronization primitive, and it doesn't allocate:
+    all of its state is kept in the trivially copyable struct State, stored inside the object,
+    so that an instance takes a few KiB of contiguous memory.
+    The host drives it completely: it executes the instructions with step or run,
+    it advances the timers with its own clock through advanceTime (or tickTimers)
+    and it updates the keyboard through setKey.
+    The instructions have the same behaviour as in Chip8, since both execute them through instructions.h.
+*/
+class Chip8Lite {
+public:
+    static constexpr int DISPLAY_WIDTH {64};
+    static constexpr int DISPLAY_HEIGHT {32};
+
+    // the timers are decreased at a rate of 60 per second
+    static constexpr std::chrono::nanoseconds TIMER_PERIOD {1'000'000'000 / 60};
+
+    // same settings as the ones of Chip8
+    enum class InstructionSet : uint8_t {chip8, schip8};
+    enum class DrawBehaviour : uint8_t {clip, wrap};
+
+    // value of m_lastPressedKey when no key has been pressed
+    static constexpr uint8_t NO_KEY {0xff};
+
+    struct State {
+        // every row of the display is a uint64_t, where the most significant bit is the column 0
+        std::array<uint64_t, DISPLAY_HEIGHT> m_frame;
+
+        // time accumulated by advanceTime since the last tick of the timers
+        std::chrono::nanoseconds m_timerRemainder;
+
+        std::array<uint8_t, 4096> m_ram;
+
+        std::array<uint16_t, 16> m_stack;
+
+        std::array<uint8_t, 16> m_registers;
+
+        uint16_t m_I;
+        uint16_t m_PC;
+
+        uint16_t m_keys; // the bit k is set if the key k is pressed
+
+        uint8_t m_lastPressedKey; // key used for instruction ldVxK, NO_KEY if there isn't one
+
+        uint8_t m_SP;
+
+        uint8_t m_delayTimer;
+        uint8_t m_soundTimer;
+
+        InstructionSet m_instructionSet;
+        DrawBehaviour m_drawBehaviour;
+
+        uint32_t m_randomState; // state of the xorshift generator used by the instruction cxkk
+    };
+
+    // the flags have the same meaning as the ones passed to the constructor of Chip8;
+    // the seed initializes the random number generator, so that the runs are reproducible
+    Chip8Lite(std::string_view flagChip8Type, std::string_view flagDrawInstruction, uint32_t randomSeed = 1);
+
+    // reads instructions from file and copies them in ram, starting from address 0x200
+    // (the bytes that don't fit in the ram are ignored)
+    void readFromFile(const std::filesystem::path& path);
+
+    // copies the program in ram, starting from address 0x200 (the bytes that don't fit in the ram are ignored)
+    void loadProgram(std::span<const uint8_t> program);
+
+    // fetches the instruction pointed by the program counter and executes it
+    void step();
+
+    // executes the given number of instructions
+    void run(uint64_t numInstructions);
+
+    // decreases the timers once every TIMER_PERIOD of elapsed time,
+    // where the elapsed time is measured by the clock of the host
+    void advanceTime(std::chrono::nanoseconds elapsed);
+
+    // decreases the timers by one
+    void tickTimers();
+
+    void setKey(uint8_t key, bool pressed);
+
+    // the sound must be played as long as the sound timer is not zero
+    bool isSoundOn() const { return m_state.m_soundTimer != 0; }
+
+    bool isPixelOn(int row, int column) const
+    {
+        return (m_state.m_frame[row] >> (DISPLAY_WIDTH - 1 - column)) & 1u;
+    }
+
+    const State& getState() const { return m_state; }
+
+private:
+    State m_state;
+
+    // gives the instructions of instructions.h access to the state (look at chip8_lite.cpp)
+    struct Machine;
+
+    void execute(uint16_t instruction);
+
+    uint8_t random();
+
+    // draws the sprite of n rows at I with its top left corner at (x, y) and tells if a pixel was unset
+    bool draw(uint8_t x, uint8_t y, uint8_t n, bool wrap);
+};
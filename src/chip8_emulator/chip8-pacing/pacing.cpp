@@ -0,0 +1,141 @@
+#include <chip8.h>
+#include <algorithm>
+#include <chrono>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <time.h>
+#endif
+
+// run waits for the end of every frame by sleeping until an absolute deadline: on Linux with
+// clock_nanosleep(TIMER_ABSTIME) on the monotonic clock (which is the clock of std::chrono::steady_clock),
+// elsewhere with std::this_thread::sleep_until.
+// A relative sleep would start counting only after the thread has computed how long it has to sleep,
+// and after a signal it would sleep its whole duration again.
+namespace
+{
+    void sleepUntil(const std::chrono::steady_clock::time_point deadline)
+    {
+#if defined(__linux__)
+        const std::chrono::nanoseconds sinceEpoch {deadline.time_since_epoch()};
+
+        timespec time {};
+        time.tv_sec = static_cast<time_t>(sinceEpoch.count() / 1'000'000'000);
+        time.tv_nsec = static_cast<long>(sinceEpoch.count() % 1'000'000'000);
+
+        // the sleep is interrupted by the signals, but the deadline stays the same
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, nullptr) == EINTR)
+        {
+        }
+#else
+        std::this_thread::sleep_until(deadline);
+#endif
+    }
+}
+
+void Chip8::waitForDeadline(std::chrono::steady_clock::time_point& deadline)
+{
+    const auto now = std::chrono::steady_clock::now();
+
+    // the instructions of the frame took longer than the frame itself
+    if (now > deadline)
+    {
+        ++m_pacingStatistics.m_missedDeadlines;
+
+        if (now - deadline > MAXIMAL_LATENESS)
+        {
+            deadline = now;
+        }
+
+        return;
+    }
+
+    // the wake up of the os can be late by a fraction of millisecond, so the last part of the wait can be spent spinning
+    if (deadline - now > m_spinDuration)
+    {
+        sleepUntil(deadline - m_spinDuration);
+    }
+
+    auto wakeUp = std::chrono::steady_clock::now();
+
+    while (wakeUp < deadline)
+    {
+        wakeUp = std::chrono::steady_clock::now();
+    }
+
+    m_pacingStatistics.m_maximalLateness = std::max(m_pacingStatistics.m_maximalLateness,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(wakeUp - deadline));
+}
+
+uint64_t Chip8::instructionsInNextFrame()
+{
+    switch (m_speed.m_unit)
+    {
+    case SpeedUnit::instructionsPerFrame:
+        return m_speed.m_amount;
+
+    case SpeedUnit::instructionsPerSecond:
+    {
+        m_speedRemainder += m_speed.m_amount;
+
+        const uint64_t count {m_speedRemainder / TIMER_FREQUENCY};
+        m_speedRemainder %= TIMER_FREQUENCY;
+
+        return count;
+    }
+
+    case SpeedUnit::uncapped:
+        return UNCAPPED_FRAME;
+    }
+
+    return 0;
+}
+
+uint64_t Chip8::finishFrame()
+{
+    if (m_frameInstructionsLeft == 0)
+    {
+        m_frameInstructionsLeft = instructionsInNextFrame();
+    }
+
+    const uint64_t count {m_frameInstructionsLeft};
+
+    executeInstructions(count);
+    m_frameInstructionsLeft = 0;
+
+    return count;
+}
+
+uint64_t Chip8::executeFrame(const std::chrono::steady_clock::time_point frameEnd)
+{
+    if (m_speed.m_unit != SpeedUnit::uncapped)
+    {
+        return finishFrame();
+    }
+
+    // the frame lasts until frameEnd, whatever was left of it
+    m_frameInstructionsLeft = 0;
+
+    // reading the clock costs about as much as a few instructions, so it is read once per batch
+    uint64_t count {0};
+
+    do
+    {
+        const uint64_t skippedInstructions {m_idleStatistics.m_skippedInstructions};
+
+        executeInstructions(UNCAPPED_BATCH);
+        count += UNCAPPED_BATCH;
+
+        // in an idle loop nothing can happen before the next tick of the timers,
+        // so there is no point in spinning until then
+        if (m_idleStatistics.m_skippedInstructions != skippedInstructions)
+        {
+            const auto nextTick = m_startTime + FRAME_PERIOD * static_cast<int64_t>(currentTick() + 1);
+
+            sleepUntil(std::min(frameEnd, nextTick));
+        }
+    }
+    while (m_isRunning && std::chrono::steady_clock::now() < frameEnd);
+
+    return count;
+}
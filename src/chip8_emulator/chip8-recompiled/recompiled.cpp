@@ -0,0 +1,107 @@
+#include <chip8.h>
+#include <invalidation.h>
+#include <algorithm>
+#include <cassert>
+
+std::vector<const Chip8::RecompiledProgram*>& Chip8::recompiledPrograms()
+{
+    // function-local, so that it is initialized before the generated sources register their programs
+    static std::vector<const RecompiledProgram*> programs {};
+
+    return programs;
+}
+
+bool Chip8::registerRecompiledProgram(const RecompiledProgram& program)
+{
+    recompiledPrograms().push_back(&program);
+
+    return true;
+}
+
+// The rom is always copied in ram starting from 0x200, so a program matches
+// if its rom is found there (the rest of the ram doesn't matter).
+void Chip8::attachRecompiledProgram()
+{
+    RecompiledCode& code {*m_recompiledCode};
+
+    code.m_blocks = {};
+    code.m_isCode.reset();
+    code.m_statistics.m_blocks = 0;
+
+    constexpr size_t programStart {0x200};
+
+    for (const RecompiledProgram* program : recompiledPrograms())
+    {
+        const std::span<const uint8_t> rom {program->m_rom};
+
+        if (rom.size() > m_ramPtr->size() - programStart ||
+            !std::equal(rom.begin(), rom.end(), m_ramPtr->begin() + programStart))
+        {
+            continue;
+        }
+
+        for (const RecompiledBlock& block : program->m_blocks)
+        {
+            const size_t end = block.m_address + 2*size_t {block.m_length};
+
+            assert(block.m_length > 0 && block.m_length <= RecompiledCode::MAXIMAL_BLOCK_LENGTH);
+            assert(end <= m_ramPtr->size());
+
+            code.m_blocks[block.m_address] = &block;
+
+            for (size_t byte = block.m_address; byte < end; ++byte)
+            {
+                code.m_isCode[byte] = true;
+            }
+        }
+
+        code.m_statistics.m_blocks = program->m_blocks.size();
+        return;
+    }
+}
+
+void Chip8::runRecompiled(uint64_t count)
+{
+    RecompiledCode& code {*m_recompiledCode};
+
+    while (count > 0)
+    {
+        const Address pc = m_PC;
+
+        // the recompiled blocks go on after dxyn, so they can't wait for the vertical blank
+        const RecompiledBlock* block = (pc < code.m_blocks.size() && !m_waitForVBlank) ? code.m_blocks[pc] : nullptr;
+
+        if (block != nullptr)
+        {
+            const uint32_t numInstructions = static_cast<uint32_t>(std::min<uint64_t>(block->m_length, count));
+
+            m_PC = block->m_function(*this, numInstructions);
+
+            count -= numInstructions;
+            code.m_statistics.m_nativeInstructions += numInstructions;
+            continue;
+        }
+
+        // indirect jumps, code written at runtime and code that the recompiler didn't reach
+        step();
+        --count;
+        ++code.m_statistics.m_interpretedInstructions;
+    }
+}
+
+// the blocks discarded are executed by the interpreter from then on
+void Chip8::RecompiledCode::invalidate(const Address first, const Address last)
+{
+    discardOverlappingCode(m_isCode, first, last, MAXIMAL_BLOCK_LENGTH,
+        [this](const size_t start) { return (m_blocks[start] != nullptr) ? size_t {m_blocks[start]->m_length} : 0; },
+        [this](const size_t start)
+        {
+            m_blocks[start] = nullptr;
+            ++m_statistics.m_invalidations;
+        });
+}
+
+Chip8::RecompiledStatistics Chip8::getRecompiledStatistics() const
+{
+    return m_recompiledCode ? m_recompiledCode->m_statistics : RecompiledStatistics {};
+}
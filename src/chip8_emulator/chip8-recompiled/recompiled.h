@@ -0,0 +1,24 @@
+#pragma once
+
+#include <chip8.h>
+
+// The sources generated by chip8_recompiler only include this header.
+// Their blocks work directly on the registers of the Chip8 and leave to the interpreter
+// all the instructions that touch the display, the keyboard, the timers, the stack or the ram,
+// so that these keep exactly the behaviour they have in Chip8::execute.
+struct Chip8::RecompiledAccess {
+    static uint8_t* registers(Chip8& c) { return c.m_registers.data(); }
+
+    static uint16_t& I(Chip8& c) { return c.m_I; }
+
+    static bool isSchip8(const Chip8& c) { return c.m_quirks.m_instructionSet == InstructionSet::schip8; }
+
+    // executes the instruction as if it was at address pc and returns the new program counter
+    static uint16_t execute(Chip8& c, const uint16_t pc, const uint16_t instruction)
+    {
+        c.m_PC = pc;
+        (c.*c.m_execute)(Instruction(instruction));
+
+        return c.m_PC;
+    }
+};
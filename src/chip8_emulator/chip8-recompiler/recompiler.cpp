@@ -0,0 +1,497 @@
+#include <chip8.h>
+#include <read_from_file.h>
+#include <array>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+// chip8_recompiler translates a rom into a C++ source that, linked together with the library chip8,
+// lets the engine recompiled run the rom without interpreting most of its instructions.
+// It finds the blocks of the rom that are reachable from 0x200 following jumps, calls and skips,
+// and emits one function for each of them.
+// The indirect jumps (bnnn), fx0a and the unknown instructions that stop the program counter
+// are left to the interpreter, and so is every address the recompiler couldn't reach.
+// The instructions touching the display, the keyboard, the timers, the stack or the ram
+// are executed by calling the interpreter from the generated code (look at recompiled.h),
+// so that their behaviour is exactly the one of Chip8::execute.
+//
+// usage: chip8_recompiler <path/to/rom.ch8> <path/to/output.cpp>
+namespace
+{
+    constexpr size_t PROGRAM_START {0x200};
+    constexpr size_t RAM_SIZE {4096};
+
+    enum class Kind {
+        inlined, // translated into C++
+        interpreted, // executed by the interpreter, doesn't change the control flow
+        writesRam, // executed by the interpreter, ends the block because it may overwrite it
+        jump, // 1nnn
+        skip, // 3xkk, 4xkk, 5xy0, 9xy0, translated into C++
+        interpretedBranch, // 2nnn, 00ee, ex9e, exa1: executed by the interpreter, which gives the next address
+        fallback // not recompiled at all
+    };
+
+    Kind classify(const uint16_t instruction)
+    {
+        const uint16_t n = instruction & 0xf;
+        const uint16_t kk = instruction & 0xff;
+
+        switch (instruction >> 12u)
+        {
+        case 0x0:
+            return (instruction == 0x00ee) ? Kind::interpretedBranch : Kind::interpreted;
+
+        case 0x1:
+            return Kind::jump;
+
+        case 0x2:
+            return Kind::interpretedBranch;
+
+        case 0x3: case 0x4: case 0x5:
+            return Kind::skip;
+
+        case 0x6: case 0x7: case 0xa:
+            return Kind::inlined;
+
+        case 0x8:
+            return (n <= 7 || n == 0xe) ? Kind::inlined : Kind::fallback;
+
+        case 0x9:
+            return (n == 0) ? Kind::skip : Kind::fallback;
+
+        case 0xb:
+            return Kind::fallback;
+
+        case 0xc: case 0xd:
+            return Kind::interpreted;
+
+        case 0xe:
+            return (kk == 0x9e || kk == 0xa1) ? Kind::interpretedBranch : Kind::fallback;
+
+        case 0xf:
+            if (kk == 0x1e || kk == 0x29)
+            {
+                return Kind::inlined;
+            }
+            if (kk == 0x33 || kk == 0x55)
+            {
+                return Kind::writesRam;
+            }
+            return (kk == 0x0a) ? Kind::fallback : Kind::interpreted;
+
+        default:
+            return Kind::fallback;
+        }
+    }
+
+    bool endsBlock(const Kind kind)
+    {
+        return kind != Kind::inlined && kind != Kind::interpreted;
+    }
+
+    // the addresses where the execution can continue after the instruction at address pc
+    // (only for the instructions that end a block)
+    std::vector<size_t> successors(const uint16_t instruction, const size_t pc)
+    {
+        switch (classify(instruction))
+        {
+        case Kind::jump:
+            return {static_cast<size_t>(instruction & 0xfff)};
+
+        case Kind::skip:
+            return {pc + 2, pc + 4};
+
+        case Kind::interpretedBranch:
+            if (instruction == 0x00ee)
+            {
+                // the return addresses are reached as successors of the calls
+                return {};
+            }
+            if ((instruction >> 12u) == 0x2)
+            {
+                return {static_cast<size_t>(instruction & 0xfff), pc + 2};
+            }
+            return {pc + 2, pc + 4};
+
+        case Kind::writesRam:
+            return {pc + 2};
+
+        case Kind::fallback:
+            // after fx0a the execution continues with the next instruction
+            return ((instruction >> 12u) == 0xf) ? std::vector<size_t> {pc + 2} : std::vector<size_t> {};
+
+        case Kind::inlined:
+        case Kind::interpreted:
+        default:
+            return {};
+        }
+    }
+
+    std::string hex(const size_t value, const int digits)
+    {
+        std::array<char, 16> buffer {};
+        std::snprintf(buffer.data(), buffer.size(), "%0*zx", digits, value);
+
+        return std::string {"0x"} + buffer.data();
+    }
+
+    std::string reg(const int x)
+    {
+        return "V[" + hex(static_cast<size_t>(x), 1) + "]";
+    }
+
+    // the C++ translation of an instruction that doesn't end its block
+    std::string translate(const uint16_t instruction, const size_t pc)
+    {
+        const int x = (instruction & 0xf00) >> 8u;
+        const int y = (instruction & 0xf0) >> 4u;
+        const size_t kk = instruction & 0xff;
+        const size_t nnn = instruction & 0xfff;
+
+        if (classify(instruction) == Kind::interpreted)
+        {
+            return "Access::execute(c, " + hex(pc, 3) + ", " + hex(instruction, 4) + ");";
+        }
+
+        // the same operations, in the same order, as the member functions of Chip8 executing them
+        switch (instruction >> 12u)
+        {
+        case 0x6:
+            return reg(x) + " = " + hex(kk, 2) + ";";
+
+        case 0x7:
+            return reg(x) + " = static_cast<uint8_t>(" + reg(x) + " + " + hex(kk, 2) + ");";
+
+        case 0xa:
+            return "I = " + hex(nnn, 3) + ";";
+
+        case 0x8:
+            switch (instruction & 0xf)
+            {
+            case 0x0:
+                return reg(x) + " = " + reg(y) + ";";
+            case 0x1:
+                return reg(x) + " = static_cast<uint8_t>(" + reg(x) + " | " + reg(y) + ");";
+            case 0x2:
+                return reg(x) + " = static_cast<uint8_t>(" + reg(x) + " & " + reg(y) + ");";
+            case 0x3:
+                return reg(x) + " = static_cast<uint8_t>(" + reg(x) + " ^ " + reg(y) + ");";
+            case 0x4:
+                if (x == y)
+                {
+                    // Chip8::addVxVy compares Vx with itself after the addition, so VF is always 0
+                    return reg(x) + " = static_cast<uint8_t>(" + reg(x) + " + " + reg(y) + "); V[0xf] = 0;";
+                }
+                return reg(x) + " = static_cast<uint8_t>(" + reg(x) + " + " + reg(y) + "); " +
+                    "V[0xf] = (" + reg(x) + " < " + reg(y) + ") ? 1 : 0;";
+            case 0x5:
+                return "{ const uint8_t vx = " + reg(x) + "; const uint8_t vy = " + reg(y) + "; " +
+                    reg(x) + " = static_cast<uint8_t>(vx - vy); V[0xf] = (vx >= vy) ? 1 : 0; }";
+            // the shifts depend on the instruction set, which is only known at runtime
+            case 0x6:
+                return "if (Access::isSchip8(c)) { const uint8_t vx = " + reg(x) + "; " +
+                    "V[0xf] = static_cast<uint8_t>(vx & 1); " + reg(x) + " = static_cast<uint8_t>(" + reg(x) + " / 2); } " +
+                    "else { const uint8_t vy = " + reg(y) + "; " + reg(x) + " = static_cast<uint8_t>(vy >> 1u); " +
+                    "V[0xf] = static_cast<uint8_t>(vy & 1); }";
+            case 0xe:
+                return "if (Access::isSchip8(c)) { const uint8_t vx = " + reg(x) + "; " +
+                    "V[0xf] = static_cast<uint8_t>(vx >> 7u); " + reg(x) + " = static_cast<uint8_t>(vx * 2); } " +
+                    "else { const uint8_t vy = " + reg(y) + "; " + reg(x) + " = static_cast<uint8_t>(vy << 1u); " +
+                    "V[0xf] = static_cast<uint8_t>(vy & 0x80); }";
+            case 0x7:
+                return "{ const uint8_t vx = " + reg(x) + "; const uint8_t vy = " + reg(y) + "; " +
+                    reg(x) + " = static_cast<uint8_t>(vy - vx); V[0xf] = (vy > vx) ? 1 : 0; }";
+            default:
+                break;
+            }
+            break;
+
+        case 0xf:
+            if ((instruction & 0xff) == 0x1e)
+            {
+                return "I = static_cast<uint16_t>(" + reg(x) + " + I);";
+            }
+            return "I = static_cast<uint16_t>(" + reg(x) + " * 5);";
+
+        default:
+            break;
+        }
+
+        return {};
+    }
+
+    // the C++ translation of the instruction ending its block, which returns the next program counter
+    std::string translateLast(const uint16_t instruction, const size_t pc)
+    {
+        const int x = (instruction & 0xf00) >> 8u;
+        const int y = (instruction & 0xf0) >> 4u;
+        const size_t kk = instruction & 0xff;
+
+        const std::string next {hex(pc + 2, 3)};
+        const std::string skip {hex(pc + 4, 3)};
+
+        switch (classify(instruction))
+        {
+        case Kind::jump:
+            return "return " + hex(instruction & 0xfff, 3) + ";";
+
+        case Kind::skip:
+            // a register is always equal to itself
+            if ((instruction >> 12u) == 0x5 && x == y)
+            {
+                return "return " + skip + ";";
+            }
+            if ((instruction >> 12u) == 0x9 && x == y)
+            {
+                return "return " + next + ";";
+            }
+
+            switch (instruction >> 12u)
+            {
+            case 0x3:
+                return "return (" + reg(x) + " == " + hex(kk, 2) + ") ? " + skip + " : " + next + ";";
+            case 0x4:
+                return "return (" + reg(x) + " != " + hex(kk, 2) + ") ? " + skip + " : " + next + ";";
+            case 0x5:
+                return "return (" + reg(x) + " == " + reg(y) + ") ? " + skip + " : " + next + ";";
+            default:
+                return "return (" + reg(x) + " != " + reg(y) + ") ? " + skip + " : " + next + ";";
+            }
+
+        case Kind::interpretedBranch:
+            return "return Access::execute(c, " + hex(pc, 3) + ", " + hex(instruction, 4) + ");";
+
+        case Kind::writesRam:
+            return "Access::execute(c, " + hex(pc, 3) + ", " + hex(instruction, 4) + "); return " + next + ";";
+
+        case Kind::inlined:
+        case Kind::interpreted:
+        case Kind::fallback:
+        default:
+            return translate(instruction, pc) + " return " + next + ";";
+        }
+    }
+
+    class Recompiler {
+    public:
+        explicit Recompiler(std::vector<uint8_t>&& rom) : m_rom {std::move(rom)} {}
+
+        void findBlocks()
+        {
+            std::vector<size_t> toVisit {PROGRAM_START};
+
+            while (!toVisit.empty())
+            {
+                const size_t leader = toVisit.back();
+                toVisit.pop_back();
+
+                if (!isCode(leader) || !m_leaders.insert(leader).second)
+                {
+                    continue;
+                }
+
+                for (size_t pc = leader, length = 0; isCode(pc); pc += 2, ++length)
+                {
+                    const uint16_t instruction = fetch(pc);
+
+                    // a block too long is split in more blocks
+                    if (length == Chip8::RecompiledCode::MAXIMAL_BLOCK_LENGTH)
+                    {
+                        toVisit.push_back(pc);
+                        break;
+                    }
+
+                    if (endsBlock(classify(instruction)))
+                    {
+                        for (size_t successor : successors(instruction, pc))
+                        {
+                            toVisit.push_back(successor);
+                        }
+                        break;
+                    }
+                }
+            }
+        }
+
+        void write(std::ostream& out, const std::string& romName) const
+        {
+            out << "// Generated by chip8_recompiler from " << romName << ", do not edit.\n";
+            out << "#include <recompiled.h>\n\n";
+            out << "namespace\n{\n";
+            out << "    using Access = Chip8::RecompiledAccess;\n\n";
+
+            out << "    constexpr uint8_t rom[] {";
+            for (size_t i = 0; i < m_rom.size(); ++i)
+            {
+                out << ((i % 16 == 0) ? "\n        " : " ") << hex(m_rom[i], 2) << ",";
+            }
+            out << "\n    };\n";
+
+            std::vector<std::pair<size_t, size_t>> blocks {};
+
+            for (size_t leader : m_leaders)
+            {
+                const size_t length = writeBlock(out, leader);
+
+                if (length != 0)
+                {
+                    blocks.emplace_back(leader, length);
+                }
+            }
+
+            // an array can't be empty
+            if (blocks.empty())
+            {
+                out << "\n    const Chip8::RecompiledProgram program {rom, {}};\n\n";
+            }
+            else
+            {
+                out << "\n    constexpr Chip8::RecompiledBlock blocks[] {\n";
+                for (const auto& [address, length] : blocks)
+                {
+                    out << "        {" << hex(address, 3) << ", " << length << ", &block_" << hex(address, 3) << "},\n";
+                }
+                out << "    };\n\n";
+
+                out << "    const Chip8::RecompiledProgram program {rom, blocks};\n\n";
+            }
+            out << "    const bool registered = Chip8::registerRecompiledProgram(program);\n";
+            out << "}\n";
+
+            std::cout << "Recompiled " << blocks.size() << " blocks of " << romName << ".\n";
+        }
+
+    private:
+        std::vector<uint8_t> m_rom;
+
+        // the first addresses of the blocks, in increasing order
+        std::set<size_t> m_leaders {};
+
+        // tells if a whole instruction of the rom starts at the address
+        bool isCode(const size_t address) const
+        {
+            return address >= PROGRAM_START && address + 1 < PROGRAM_START + m_rom.size();
+        }
+
+        uint16_t fetch(const size_t address) const
+        {
+            return static_cast<uint16_t>((m_rom[address - PROGRAM_START] << 8u) | m_rom[address + 1 - PROGRAM_START]);
+        }
+
+        // writes the function of the block starting at leader and returns its length,
+        // 0 if its first instruction is left to the interpreter (and nothing is written).
+        // The block stops before the next leader, so that the blocks don't overlap
+        size_t writeBlock(std::ostream& out, const size_t leader) const
+        {
+            std::vector<std::string> lines {};
+
+            size_t length = 0;
+            size_t pc = leader;
+            bool returned = false;
+
+            while (isCode(pc) && length < Chip8::RecompiledCode::MAXIMAL_BLOCK_LENGTH)
+            {
+                const uint16_t instruction = fetch(pc);
+                const Kind kind = classify(instruction);
+
+                if (kind == Kind::fallback || (pc != leader && m_leaders.contains(pc)))
+                {
+                    break;
+                }
+
+                // the caller may ask to execute only the first n instructions
+                if (length != 0)
+                {
+                    lines.push_back("if (n == " + std::to_string(length) + ") { return " + hex(pc, 3) + "; }");
+                }
+
+                ++length;
+
+                if (endsBlock(kind))
+                {
+                    lines.push_back(translateLast(instruction, pc));
+                    returned = true;
+                    break;
+                }
+
+                lines.push_back(translate(instruction, pc));
+                pc += 2;
+            }
+
+            if (length == 0)
+            {
+                return 0;
+            }
+
+            if (!returned)
+            {
+                lines.push_back("return " + hex(pc, 3) + ";");
+            }
+
+            out << "\n    uint16_t block_" << hex(leader, 3) << "(Chip8& c, [[maybe_unused]] uint32_t n)\n    {\n";
+            out << "        [[maybe_unused]] uint8_t* V = Access::registers(c);\n";
+            out << "        [[maybe_unused]] uint16_t& I = Access::I(c);\n\n";
+            for (const std::string& line : lines)
+            {
+                out << "        " << line << "\n";
+            }
+            out << "    }\n";
+
+            return length;
+        }
+    };
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3)
+    {
+        std::cout << "Usage: chip8_recompiler <path/to/rom.ch8> <path/to/output.cpp>\n";
+        return 1;
+    }
+
+    const std::filesystem::path romPath {argv[1]};
+
+    if (!std::filesystem::exists(romPath))
+    {
+        std::cout << "Unable to find " << romPath << ".\n";
+        return 1;
+    }
+
+    // the rom is copied in ram starting from 0x200, as readFromFile does
+    const size_t romLength {openAndComputeLength(romPath)};
+
+    if (romLength == 0)
+    {
+        std::cout << "The rom is empty.\n";
+        return 1;
+    }
+
+    if (romLength > RAM_SIZE - PROGRAM_START)
+    {
+        std::cout << "The rom doesn't fit in the ram of the chip8.\n";
+        return 1;
+    }
+
+    std::vector<uint8_t> rom(romLength);
+    copyFromBinaryFile(romPath, reinterpret_cast<char*>(rom.data()));
+
+    Recompiler recompiler {std::move(rom)};
+    recompiler.findBlocks();
+
+    std::ofstream output {argv[2]};
+
+    if (!output.is_open())
+    {
+        std::cout << "Unable to open file.\n";
+        return 1;
+    }
+
+    recompiler.write(output, romPath.filename().string());
+
+    return 0;
+}
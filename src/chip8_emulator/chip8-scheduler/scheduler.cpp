@@ -0,0 +1,65 @@
+#include <chip8.h>
+
+// With Scheduling::singleThread the instructions and the timers are run by the same thread,
+// in a fixed ratio of instructions (given by m_speed) for every tick of the timers.
+// The timer threads are never spawned and nothing depends on how the os schedules the threads:
+// two runs of the same rom with the same keys pressed at the same frames give the same result
+// (as long as it doesn't use cxkk, whose numbers are random).
+// The emulator calls runFrames from the thread handling the window, once for the frames due
+// in real time, while a headless program can call it as fast as it wants.
+void Chip8::runFrames(const uint64_t numFrames)
+{
+    m_scheduling = Scheduling::singleThread;
+
+    for (uint64_t frame = 0; frame < numFrames; ++frame)
+    {
+        finishFrame();
+
+        tickTimers();
+    }
+
+    m_display->publish(*m_frameBuffer);
+
+    // the queue of the keyboard is emptied regularly, so that it never fills up between two fx0a
+    readKeyEdges();
+}
+
+void Chip8::tickTimers()
+{
+    // the ticks are counted in both modes, since the vertical blank follows them too (look at m_waitForVBlank)
+    ++m_ticks;
+
+    if (m_timerMode == TimerMode::lazy)
+    {
+        // the sound started by ldSTVx must stop when the sound timer reaches 0
+        if (m_isPlayingSound)
+        {
+            updateSound();
+        }
+
+        return;
+    }
+
+    // the sound is played as long as the sound timer is not zero
+    if (m_soundTimer != 0 && !m_isPlayingSound)
+    {
+        m_playSoundCallback();
+        m_isPlayingSound = true;
+    }
+
+    if (m_delayTimer != 0)
+    {
+        --m_delayTimer;
+    }
+
+    if (m_soundTimer != 0)
+    {
+        --m_soundTimer;
+    }
+
+    if (m_soundTimer == 0 && m_isPlayingSound)
+    {
+        m_pauseSoundCallback();
+        m_isPlayingSound = false;
+    }
+}
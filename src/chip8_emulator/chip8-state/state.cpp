@@ -0,0 +1,138 @@
+#include <chip8.h>
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+// The state is a single struct of a fixed size (about 4.4 KiB, mostly the ram), so saving it
+// is one copy of the ram plus a few registers, and it can be written or read with one copy of its bytes.
+// The timers are saved as their values at the current tick, whichever TimerMode computed them,
+// so a state saved with a mode can be loaded with the other one.
+static_assert(std::is_trivially_copyable_v<Chip8::State>);
+static_assert(std::has_unique_object_representations_v<Chip8::State>, "the state must not have padding");
+static_assert(sizeof(Chip8::State) == 4448);
+static_assert(std::is_same_v<Chip8::Display::Row, uint64_t> && Chip8::Display::DISPLAY_HEIGHT == 32);
+
+Chip8::State Chip8::saveState() const
+{
+    State state {};
+
+    state.m_magic = STATE_MAGIC;
+    state.m_version = STATE_VERSION;
+
+    const uint64_t tick {currentTick()};
+
+    state.m_ticks = m_ticks;
+    state.m_vblankTick = m_vblankTick;
+    state.m_frameInstructionsLeft = m_frameInstructionsLeft;
+    state.m_display = m_display->getDisplayFrame();
+    state.m_ram = *m_ramPtr;
+    state.m_stack = m_stack;
+    state.m_I = m_I;
+    state.m_PC = m_PC;
+    state.m_pressedKeys = m_keyboard->getPressedKeys();
+    state.m_registers = m_registers;
+    state.m_SP = m_SP;
+
+    if (m_timerMode == TimerMode::lazy)
+    {
+        state.m_delayTimer = m_lazyDelayTimer.valueAt(tick);
+        state.m_soundTimer = m_lazySoundTimer.valueAt(tick);
+    }
+    else
+    {
+        state.m_delayTimer = m_delayTimer;
+        state.m_soundTimer = m_soundTimer;
+    }
+
+    state.m_lastPressedKey = m_lastPressedKey.value_or(NO_KEY);
+    state.m_instructionSet = static_cast<uint8_t>(m_quirks.m_instructionSet);
+    state.m_drawBehaviour = static_cast<uint8_t>(m_quirks.m_drawBehaviour);
+
+    // it is less than TIMER_FREQUENCY
+    state.m_speedRemainder = static_cast<uint8_t>(m_speedRemainder);
+
+    return state;
+}
+
+Chip8::LoadStateResult Chip8::loadState(const State& state)
+{
+    if (state.m_magic != STATE_MAGIC || state.m_version != STATE_VERSION)
+    {
+        return LoadStateResult::wrongVersion;
+    }
+
+    // the instructions depending on the quirks have been selected when the chip8 was constructed
+    if (state.m_instructionSet != static_cast<uint8_t>(m_quirks.m_instructionSet) ||
+        state.m_drawBehaviour != static_cast<uint8_t>(m_quirks.m_drawBehaviour))
+    {
+        return LoadStateResult::wrongSettings;
+    }
+
+    // the instructions index the stack with m_SP and the ram with m_PC and m_I without any check,
+    // so the state could make them read and write outside of the chip8.
+    // The largest access from I is the one of fx55 and fx65, which cover 16 bytes
+    const auto isInRam = [this](const size_t address, const size_t length) { return address + length <= m_ramPtr->size(); };
+
+    if (state.m_SP >= state.m_stack.size() || !isInRam(state.m_PC, 2) || !isInRam(state.m_I, 16) ||
+        !std::all_of(state.m_stack.begin(), state.m_stack.end(), [&isInRam](const Address address) { return isInRam(address, 2); }))
+    {
+        return LoadStateResult::invalidState;
+    }
+
+    *m_ramPtr = state.m_ram;
+    m_registers = state.m_registers;
+    m_stack = state.m_stack;
+    m_I = state.m_I;
+    m_PC = state.m_PC;
+    m_SP = state.m_SP;
+
+    m_speedRemainder = state.m_speedRemainder % TIMER_FREQUENCY;
+    m_frameInstructionsLeft = state.m_frameInstructionsLeft;
+
+    m_ticks = state.m_ticks;
+    m_vblankTick = state.m_vblankTick;
+
+    const uint64_t tick {currentTick()};
+
+    m_lazyDelayTimer = {state.m_delayTimer, tick};
+    m_lazySoundTimer = {state.m_soundTimer, tick};
+    m_delayTimer = state.m_delayTimer;
+    m_soundTimer = state.m_soundTimer;
+
+    if (m_timerMode == TimerMode::lazy)
+    {
+        updateSound();
+    }
+
+    m_display->setDisplayFrame(state.m_display);
+    m_keyboard->setPressedKeys(state.m_pressedKeys);
+    m_lastPressedKey = (state.m_lastPressedKey < 16) ? std::optional<Register> {state.m_lastPressedKey} : std::nullopt;
+
+    // all the ram may have changed, so the engines must forget what they know about it
+    ramWritten(0, static_cast<Address>(m_ramPtr->size() - 1));
+
+    if (m_recompiledCode)
+    {
+        attachRecompiledProgram();
+    }
+
+    if (m_fusions)
+    {
+        fuseInstructions();
+    }
+
+    return LoadStateResult::loaded;
+}
+
+Chip8::LoadStateResult Chip8::loadState(const std::span<const std::byte> bytes)
+{
+    if (bytes.size() != sizeof(State))
+    {
+        return LoadStateResult::wrongSize;
+    }
+
+    State state;
+    std::memcpy(&state, bytes.data(), sizeof(State));
+
+    return loadState(state);
+}
@@ -0,0 +1,166 @@
+#include <dispatch.h>
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+#if defined(CHIP8_THREADED) && (defined(__GNUC__) || defined(__clang__))
+#define CHIP8_THREADED_AVAILABLE
+#endif
+
+#ifdef CHIP8_THREADED_AVAILABLE
+
+// The threaded interpreter gives every instruction its own label: at the end of each of them,
+// the next instruction is fetched and the execution jumps directly to its label
+// through the address stored in a table (labels as values, a GCC and Clang extension).
+// This way every instruction has its own indirect jump, whose target the branch predictor
+// can learn separately, instead of the single jump of the switch in execute.
+// The instructions are decoded by decode<Q>: every handler of the dispatch table has its label,
+// which executes the same member functions and moves the program counter exactly as the handler does.
+
+// the labels as values are an extension, which -Wpedantic reports
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+template <Chip8::Quirks Q>
+void Chip8::runThreaded(uint64_t count)
+{
+    // the label of every handler of the dispatch table
+    static const std::pair<Handler, const void*> labels[] = {
+        {&Dispatch::cls, &&l_cls}, {&Dispatch::ret, &&l_ret}, {&Dispatch::skipUnknown, &&l_skipUnknown},
+        {&Dispatch::stopUnknown, &&l_stopUnknown}, {&Dispatch::jp, &&l_jp}, {&Dispatch::call, &&l_call},
+        {&Dispatch::se, &&l_se}, {&Dispatch::sne, &&l_sne}, {&Dispatch::seVxVy, &&l_seVxVy}, {&Dispatch::ld, &&l_ld},
+        {&Dispatch::add, &&l_add}, {&Dispatch::ldVxVy, &&l_ldVxVy}, {&Dispatch::bitOr, &&l_bitOr},
+        {&Dispatch::bitAnd, &&l_bitAnd}, {&Dispatch::bitXor, &&l_bitXor}, {&Dispatch::addVxVy, &&l_addVxVy},
+        {&Dispatch::sub, &&l_sub}, {&Dispatch::shr<Q>, &&l_shr}, {&Dispatch::subn, &&l_subn},
+        {&Dispatch::shl<Q>, &&l_shl}, {&Dispatch::sneVxVy, &&l_sneVxVy}, {&Dispatch::ldI, &&l_ldI},
+        {&Dispatch::jpV0, &&l_jpV0}, {&Dispatch::rnd, &&l_rnd}, {&Dispatch::drw<Q>, &&l_drw}, {&Dispatch::skp, &&l_skp},
+        {&Dispatch::sknp, &&l_sknp}, {&Dispatch::ldVxDT, &&l_ldVxDT}, {&Dispatch::ldVxK, &&l_ldVxK},
+        {&Dispatch::ldDTVx, &&l_ldDTVx}, {&Dispatch::ldSTVx, &&l_ldSTVx}, {&Dispatch::addI, &&l_addI},
+        {&Dispatch::ldFVx, &&l_ldFVx}, {&Dispatch::ldB, &&l_ldB}, {&Dispatch::ldIVx<Q>, &&l_ldIVx},
+        {&Dispatch::ldVxI<Q>, &&l_ldVxI}
+    };
+
+    // the index in labels of each of the 65536 possible instructions, built only once for the quirks Q
+    // from the dispatch table (which setEngine selected for them)
+    static const std::unique_ptr<std::array<uint8_t, 65536>> operations = [&dispatch = *m_dispatchTable]
+    {
+        std::unique_ptr<std::array<uint8_t, 65536>> res = std::make_unique<std::array<uint8_t, 65536>>();
+
+        for (size_t inst = 0; inst < res->size(); ++inst)
+        {
+            const auto label = std::ranges::find(labels, dispatch[inst].m_handler, &std::pair<Handler, const void*>::first);
+
+            // every handler of decode<Q> must have its label
+            assert(label != std::end(labels));
+
+            (*res)[inst] = static_cast<uint8_t>(label - std::begin(labels));
+        }
+
+        return res;
+    }();
+
+    const std::array<uint8_t, 65536>& ops {*operations};
+    const std::array<Register, 4096>& ram {*m_ramPtr};
+
+    uint16_t instruction {};
+
+    // operands of the instruction being executed
+    const auto x = [&instruction] { return static_cast<uint8_t>((instruction & 0xf00) >> 8u); };
+    const auto y = [&instruction] { return static_cast<uint8_t>((instruction & 0xf0) >> 4u); };
+    const auto kk = [&instruction] { return static_cast<uint8_t>(instruction & 0xff); };
+    const auto n = [&instruction] { return static_cast<uint8_t>(instruction & 0xf); };
+    const auto nnn = [&instruction] { return static_cast<uint16_t>(instruction & 0xfff); };
+
+    const auto next = [this] { m_PC = static_cast<Address>(m_PC + 2); };
+
+// fetches the instruction pointed by m_PC and jumps to its label
+#define CHIP8_DISPATCH() \
+    instruction = static_cast<uint16_t>((ram[m_PC] << 8u) | ram[m_PC+1]); \
+    goto *labels[ops[instruction]].second
+
+// ends the execution of an instruction
+#define CHIP8_NEXT() \
+    if (--count == 0) { return; } \
+    CHIP8_DISPATCH()
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    CHIP8_DISPATCH();
+
+l_cls: cls(); next(); CHIP8_NEXT();
+l_ret: ret(); next(); CHIP8_NEXT();
+l_skipUnknown: next(); CHIP8_NEXT();
+l_stopUnknown: CHIP8_NEXT();
+l_jp: jp(nnn()); CHIP8_NEXT();
+l_call: call(nnn()); CHIP8_NEXT();
+l_se: se(x(), kk()); next(); CHIP8_NEXT();
+l_sne: sne(x(), kk()); next(); CHIP8_NEXT();
+l_seVxVy: seVxVy(x(), y()); next(); CHIP8_NEXT();
+l_ld: ld(x(), kk()); next(); CHIP8_NEXT();
+l_add: add(x(), kk()); next(); CHIP8_NEXT();
+l_ldVxVy: ldVxVy(x(), y()); next(); CHIP8_NEXT();
+l_bitOr: bitOr(x(), y()); next(); CHIP8_NEXT();
+l_bitAnd: bitAnd(x(), y()); next(); CHIP8_NEXT();
+l_bitXor: bitXor(x(), y()); next(); CHIP8_NEXT();
+l_addVxVy: addVxVy(x(), y()); next(); CHIP8_NEXT();
+l_sub: sub(x(), y()); next(); CHIP8_NEXT();
+l_shr: shr<Q>(x(), y()); next(); CHIP8_NEXT();
+l_subn: subn(x(), y()); next(); CHIP8_NEXT();
+l_shl: shl<Q>(x(), y()); next(); CHIP8_NEXT();
+l_sneVxVy: sneVxVy(x(), y()); next(); CHIP8_NEXT();
+l_ldI: ldI(nnn()); next(); CHIP8_NEXT();
+l_jpV0: jpV0(nnn()); CHIP8_NEXT();
+l_rnd: rnd(x(), kk()); next(); CHIP8_NEXT();
+
+l_drw:
+    drw<Q>(x(), y(), n());
+    if (!m_waitForVBlank)
+    {
+        std::this_thread::yield();
+    }
+    next();
+    CHIP8_NEXT();
+
+l_skp: skp(x()); next(); CHIP8_NEXT();
+l_sknp: sknp(x()); next(); CHIP8_NEXT();
+l_ldVxDT: ldVxDT(x()); next(); CHIP8_NEXT();
+l_ldVxK: ldVxK(x()); next(); CHIP8_NEXT();
+l_ldDTVx: ldDTVx(x()); next(); CHIP8_NEXT();
+l_ldSTVx: ldSTVx(x()); next(); CHIP8_NEXT();
+l_addI: addI(x()); next(); CHIP8_NEXT();
+l_ldFVx: ldFVx(x()); next(); CHIP8_NEXT();
+l_ldB: ldB(x()); next(); CHIP8_NEXT();
+l_ldIVx: ldIVx<Q>(x()); next(); CHIP8_NEXT();
+l_ldVxI: ldVxI<Q>(x()); next(); CHIP8_NEXT();
+
+#undef CHIP8_NEXT
+#undef CHIP8_DISPATCH
+}
+
+#pragma GCC diagnostic pop
+
+#else
+
+// without labels as values the engine threaded executes the instructions through the switch
+template <Chip8::Quirks Q>
+void Chip8::runThreaded(uint64_t count)
+{
+    const std::array<Register, 4096>& ram {*m_ramPtr};
+
+    for (uint64_t numInstructions = 0; numInstructions < count; ++numInstructions)
+    {
+        execute<Q>(Instruction(static_cast<uint16_t>((ram[m_PC] << 8u) | ram[m_PC+1])));
+    }
+}
+
+#endif
+
+void Chip8::selectThreaded()
+{
+    m_runThreaded = withQuirks(m_quirks, []<Quirks Q>() { return &Chip8::runThreaded<Q>; });
+}
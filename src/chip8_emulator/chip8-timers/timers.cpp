@@ -53,3 +53,33 @@ void Chip8::decreaseTimer(std::atomic<Register>& timer, bool flagSound)
     }
 }
 
+
+// In TimerMode::lazy the timers don't need any thread: the tick of the timers is computed
+// from the time elapsed while run executes the rom (one tick every 1/60 s), or it is counted by tickTimers
+// when the rom is executed by runFrames or runTurbo. Both count from the same tick, so the lazy timers
+// and the vertical blank stay valid when the rom goes from one to the other (or after loadState).
+uint64_t Chip8::currentTick() const
+{
+    if (m_isRealTime)
+    {
+        return static_cast<uint64_t>((std::chrono::steady_clock::now() - m_startTime) / FRAME_PERIOD);
+    }
+
+    return m_ticks;
+}
+
+void Chip8::updateSound()
+{
+    const bool mustPlay {m_lazySoundTimer.valueAt(currentTick()) != 0};
+
+    if (mustPlay && !m_isPlayingSound)
+    {
+        m_playSoundCallback();
+    }
+    else if (!mustPlay && m_isPlayingSound)
+    {
+        m_pauseSoundCallback();
+    }
+
+    m_isPlayingSound = mustPlay;
+}
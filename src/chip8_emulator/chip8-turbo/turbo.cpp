@@ -0,0 +1,55 @@
+#include <chip8.h>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+// runTurbo doesn't use the timer threads, which are only spawned by run.
+// Instead, the emulated time is measured in executed instructions: like runFrames, every frame
+// of 1/60 s is made of the instructions given by m_speed followed by a tick of the timers.
+// The instructions of a frame are executed in one go by the selected engine,
+// unless the budget ends in the middle of the frame: the rest of the frame is kept in m_frameInstructionsLeft,
+// so splitting a budget over several calls ticks the timers after the same instructions as a single call.
+Chip8::TurboStatistics Chip8::runTurbo(const Budget unit, const uint64_t amount)
+{
+    // otherwise a budget of instructions would never be over
+    assert(m_speed.m_unit == SpeedUnit::uncapped || m_speed.m_amount > 0);
+
+    TurboStatistics statistics {};
+
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    while ((unit == Budget::instructions) ? (statistics.m_instructions < amount)
+                                          : (statistics.m_frames < amount))
+    {
+        if (m_frameInstructionsLeft == 0)
+        {
+            m_frameInstructionsLeft = instructionsInNextFrame();
+        }
+
+        uint64_t count {m_frameInstructionsLeft};
+
+        if (unit == Budget::instructions)
+        {
+            count = std::min(count, amount - statistics.m_instructions);
+        }
+
+        executeInstructions(count);
+        statistics.m_instructions += count;
+        m_frameInstructionsLeft -= count;
+
+        if (m_frameInstructionsLeft == 0)
+        {
+            ++statistics.m_frames;
+
+            tickTimers();
+        }
+    }
+
+    const auto end = std::chrono::high_resolution_clock::now();
+
+    statistics.m_seconds = std::chrono::duration<double>(end - start).count();
+    statistics.m_instructionsPerSecond = (statistics.m_seconds > 0) ?
+        static_cast<double>(statistics.m_instructions) / statistics.m_seconds : 0;
+
+    return statistics;
+}
@@ -3,16 +3,23 @@
 #include "chip8-core/chip8.h"
 #include <sound.h>
 #include <base64decode_sound.h>
+#include <charconv>
+#include <iostream>
 
 class Chip8Emulator
 {
 public:
-    // The constructor of Chip8Emulator spawns two threads: m_delayTimerThread and m_soundTimerThread
-    // (look at the Chip8 constructor for more info).
+    // The constructor of Chip8Emulator doesn't spawn any thread: the timer threads
+    // m_delayTimerThread and m_soundTimerThread are spawned when the chip8 starts running,
+    // and only with the flag -t (look at the Chip8 constructor for more info).
     Chip8Emulator(
         std::string_view flagChip8Type,
         std::string_view flagDrawInstruction,
-        std::string_view flagFading
+        std::string_view flagFading,
+        std::string_view flagScheduling,
+        std::string_view flagTimers,
+        std::string_view flagSpeed,
+        std::string_view flagVBlank
     ):
         // the callbacks playSound and pauseSound must be void functions now because
         // SDL hasn't been initialized yet; they will be changed in the body of the constructor
@@ -22,7 +29,9 @@ public:
         flagFading,
         []{},
         []{}
-        }
+        },
+        m_fadingPlane {m_chip8.m_fadingFlag},
+        m_scheduling {(flagScheduling == "-d") ? Chip8::Scheduling::singleThread : Chip8::Scheduling::threads}
     {
         // the emulator needs SDL for the sound, keyboard and display
         SDL_Init(SDL_INIT_EVERYTHING);
@@ -35,6 +44,10 @@ public:
         // which wouldn't have worked if SDL wasn't initialized
         m_chip8.m_playSoundCallback = [this]{ this->m_sound.playSound(); };
         m_chip8.m_pauseSoundCallback = [this]{ this->m_sound.pauseSound(); };
+
+        m_chip8.m_timerMode = (flagTimers == "-t") ? Chip8::TimerMode::threads : Chip8::TimerMode::lazy;
+        m_chip8.m_speed = speedFromFlag(flagSpeed);
+        m_chip8.m_waitForVBlank = (flagVBlank == "-v");
     }
 
     ~Chip8Emulator()
@@ -52,29 +65,93 @@ public:
     // This function spawns a new thread, where the instructions of the rom are executed.
     // This thread communicates with the main thread through a future and a promise, which
     // gets set when the display in the main thread has finished its initialization.
+    // With Scheduling::singleThread no thread is spawned: the main thread runs the instructions as well.
     void runEmulator(std::filesystem::path&& programPath)
     {
+        if (m_scheduling == Chip8::Scheduling::singleThread)
+        {
+            m_chip8.readFromFile(programPath);
+            m_chip8.m_isRunning = true;
+
+            // nobody waits for the display to be initialized
+            std::promise<bool> promiseDisplayInitialized;
+            renderAndKeyboard(promiseDisplayInitialized);
+
+            return;
+        }
+
         std::promise<bool> promiseDisplayInitialized;
         std::future<bool> futureDisplayInitialized = promiseDisplayInitialized.get_future();
 
+        // set before spawning the thread, so that the window doesn't close before the chip8 starts running
+        m_chip8.m_isRunning = true;
+
         // the chip8 must run the instruction in one thread
         std::thread chip8Thread {
             &Chip8Emulator::loadAndRunChip8Program,
             std::ref(*this),
             std::move(programPath),
             std::move(futureDisplayInitialized)};
-        chip8Thread.detach();
 
         // the main thread shows and updates the window and updates the pressed keys in the meantime
         renderAndKeyboard(promiseDisplayInitialized);
+
+        // once the window has been closed, the chip8 stops at the end of the frame it is executing
+        // (its pacing statistics are then available through Chip8::getPacingStatistics)
+        chip8Thread.join();
     }
 
 private:
     Sound m_sound {nullptr, 0}; // invalid sound, will become valid after SDL is initialized in the constructor
     Chip8 m_chip8;
 
-    // updates the renderer window frame buffer to show the display of the chip8
-    void renderDisplay(SDL_Renderer* renderer);
+    // fading levels of the pixels shown, only used by the render thread
+    Chip8::FadingPlane m_fadingPlane;
+
+    // whether the chip8 runs in its own thread or in the main thread, between the frames shown
+    Chip8::Scheduling m_scheduling;
+
+    // with Scheduling::singleThread, the maximal number of frames of emulated time executed at once
+    // when the main thread is late
+    static constexpr int MAXIMAL_FRAMES_BEHIND {6};
+
+    // the chip8 display is refreshed 60 times per second, so there is no point in showing more frames.
+    // When the renderer has vsync, the frames are paced by the refresh of the monitor instead
+    static constexpr int MAXIMAL_FRAME_RATE {60};
+
+    // generation of the display shown in the window (look at Chip8::Display)
+    uint32_t m_shownGeneration {0};
+
+    // the window must be drawn again even if the display didn't change (for example after being minimized)
+    bool m_mustRedraw {true};
+
+    // nothing is drawn while the window is minimized
+    bool m_isMinimized {false};
+
+    // the flag of the speed is "-u" (uncapped), or "-c" (instructions per frame) or "-i" (instructions per second)
+    // followed by the number of instructions, which has already been checked by processArguments
+    static Chip8::Speed speedFromFlag(std::string_view flagSpeed)
+    {
+        uint64_t amount {0};
+        std::from_chars(flagSpeed.data() + 2, flagSpeed.data() + flagSpeed.size(), amount);
+
+        switch (flagSpeed[1])
+        {
+        case 'u':
+            return {Chip8::SpeedUnit::uncapped, 0};
+
+        case 'c':
+            return {Chip8::SpeedUnit::instructionsPerFrame, amount};
+
+        default:
+            return {Chip8::SpeedUnit::instructionsPerSecond, amount};
+        }
+    }
+
+    // updates the renderer window frame buffer to show the display of the chip8:
+    // the pixels are written in the streaming texture, which is then copied to the whole window.
+    // Returns false, without drawing anything, if the frame would be equal to the one already shown
+    bool renderDisplay(SDL_Renderer* renderer, SDL_Texture* texture);
 
     // updates isRunning to false if the user clicks to close the window
     // and updates the pressed keys if the user presses a valid key on their keyboard
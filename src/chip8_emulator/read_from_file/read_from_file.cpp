@@ -1,4 +1,5 @@
 #include "read_from_file.h"
+#include <algorithm>
 #include <cassert>
 #include <fstream>
 #include <iostream>
@@ -51,4 +52,20 @@ void copyFromBinaryFile(const std::filesystem::path& path, char* startCopyAddres
     {
         std::cout << "Unable to open file.\n";
     }
-}
\ No newline at end of file
+}
+size_t copyFromBinaryFile(const std::filesystem::path& path, char* startCopyAddress, size_t maximalLength)
+{
+    std::ifstream file {path , std::ifstream::in | std::ifstream::binary};
+
+    if (!file.is_open())
+    {
+        std::cout << "Unable to open file.\n";
+        return 0;
+    }
+
+    size_t length {std::min(lengthOfBinaryFile(file), maximalLength)};
+
+    file.read(startCopyAddress, static_cast<std::streamsize>(length));
+
+    return length;
+}
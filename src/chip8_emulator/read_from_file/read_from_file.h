@@ -12,3 +12,7 @@ size_t openAndComputeLength(const std::filesystem::path& path);
 // in memory to copy the whole file without overwriting memory
 // that is still in use
 void copyFromBinaryFile(const std::filesystem::path& path, char* startCopyAddress);
+
+// same as above, but copies at most maximalLength bytes of the file, so that it can't write
+// past the memory available, and returns how many bytes it copied
+size_t copyFromBinaryFile(const std::filesystem::path& path, char* startCopyAddress, size_t maximalLength);
@@ -1,15 +1,31 @@
 #include "chip8_emulator/chip8_emulator.h"
 #include <iostream>
+#include <charconv>
 #include <cstring>
 
+// checks that the argument following -c and -i is a positive number of instructions
+bool isNumberOfInstructions(const char* argument)
+{
+    const char* end {argument + std::strlen(argument)};
+    uint64_t amount {0};
+
+    const auto [last, error] = std::from_chars(argument, end, amount);
+
+    return error == std::errc {} && last == end && amount > 0;
+}
+
 // sets up the arguments to construct the emulator taking them as input from the user
 // when they started the program
-const std::array<std::string ,4> processArguments(int argc, char** argv)
+const std::array<std::string ,8> processArguments(int argc, char** argv)
 {
     // default options
     std::string flagChip8 {"-chip8"}; // default is chip8 instructions
     std::string flagDrawInstruction {"-clipping"}; // default is clipping
     std::string flagFading {"-fading"}; // default is fading simulating the phosphor screen
+    std::string flagScheduling {"-threads"}; // default is running the chip8 in its own thread
+    std::string flagTimers {"-lazy"}; // default is computing the timers from the time elapsed
+    std::string flagSpeed {"-i500"}; // default is 500 instructions per second
+    std::string flagVBlank {"-noVBlank"}; // default is drawing the sprites right away
     std::string programPath {};
 
     for (int i {0}; i<argc; ++i)
@@ -30,6 +46,35 @@ const std::array<std::string ,4> processArguments(int argc, char** argv)
                 flagDrawInstruction = "-w"; // flag for wrapping sprites
                 break;
 
+            case 'd':
+                flagScheduling = "-d"; // flag for the deterministic single thread scheduling
+                break;
+
+            case 't':
+                flagTimers = "-t"; // flag for the timers decreased at every tick
+                break;
+
+            case 'c': // flag for the number of instructions per frame, followed by the number
+            case 'i': // flag for the number of instructions per second, followed by the number
+                if (i + 1 < argc && isNumberOfInstructions(argv[i + 1]))
+                {
+                    flagSpeed = std::string {'-', argv[i][1]} + argv[i + 1];
+                    ++i;
+                }
+                else
+                {
+                    std::cout << "Invalid argument" << "\n";
+                }
+                break;
+
+            case 'u':
+                flagSpeed = "-u"; // flag for executing the instructions as fast as possible
+                break;
+
+            case 'v':
+                flagVBlank = "-v"; // flag for waiting for the vertical blank before drawing
+                break;
+
             case 'h': // in case user is asking for help on how to use the program
                 std::cout << "Emulator of a chip8:" << '\n';
                 std::cout << "type the absolute path of a chip8 program to start" << '\n';
@@ -40,6 +85,22 @@ const std::array<std::string ,4> processArguments(int argc, char** argv)
                 std::cout <<
                     "-n : disables the fading effect, making the pixels flicker " <<
                     "(default: unset pixels slowly fade to black, simulating the old phosphorus screens effect)" << '\n';
+                std::cout <<
+                    "-d : runs the instructions and the timers in the main thread, in a fixed ratio of instructions per frame, " <<
+                    "so that the execution is deterministic (default: the chip8 runs in its own thread)" << '\n';
+                std::cout <<
+                    "-t : decreases the timers at every tick, in their own threads unless -d is given " <<
+                    "(default: the value of the timers is computed from the time elapsed when they are read)" << '\n';
+                std::cout <<
+                    "-c n : executes n instructions in every frame of 1/60 s (default: 500 instructions per second)" << '\n';
+                std::cout <<
+                    "-i n : executes n instructions per second (default: 500)" << '\n';
+                std::cout <<
+                    "-u : executes the instructions as fast as possible, the timers still tick 60 times per second " <<
+                    "(default: 500 instructions per second)" << '\n';
+                std::cout <<
+                    "-v : the drawing instruction waits for the next frame of 1/60 s before drawing, as on the COSMAC VIP " <<
+                    "(default: the sprites are drawn right away)" << '\n';
                 break;
 
             default:
@@ -52,7 +113,7 @@ const std::array<std::string ,4> processArguments(int argc, char** argv)
             programPath = argv[i];
         }
     }
-    const std::array<std::string ,4> res {programPath, flagChip8, flagDrawInstruction, flagFading};
+    const std::array<std::string ,8> res {programPath, flagChip8, flagDrawInstruction, flagFading, flagScheduling, flagTimers, flagSpeed, flagVBlank};
     return res;
 }
 
@@ -60,12 +121,14 @@ const std::array<std::string ,4> processArguments(int argc, char** argv)
 /*
     The main structure of this program is the following:
     - in the main thread the display and keyboard are handled;
-    - the main thread spawns two more threads (for delay and sound timer)
-      at the creation of the Chip8Emulator;
-      these two threads are joined at the distruction of the emulator;
     - the main thread spawns another thread when executing the member function
       runEmulator of Chip8Emulator: this last thread runs the instructions of
-      the Chip8 rom and is detached.
+      the Chip8 rom and is joined when the window is closed;
+    - with the flag -t, the thread running the rom spawns two more threads (for delay and sound timer)
+      when it starts running;
+      these two threads are joined at the distruction of the emulator.
+    With the flag -d no thread is spawned: the main thread executes the instructions
+    and ticks the timers between the frames it shows.
 */
 int main(int argc, char** argv)
 {
@@ -85,8 +148,12 @@ int main(int argc, char** argv)
         const std::string_view flagChip8 = settings[1];
         const std::string_view flagDrawInstruction = settings[2];
         const std::string_view fadingFlag = settings[3];
+        const std::string_view schedulingFlag = settings[4];
+        const std::string_view timersFlag = settings[5];
+        const std::string_view speedFlag = settings[6];
+        const std::string_view vblankFlag = settings[7];
 
-        Chip8Emulator emulator{flagChip8, flagDrawInstruction, fadingFlag};
+        Chip8Emulator emulator{flagChip8, flagDrawInstruction, fadingFlag, schedulingFlag, timersFlag, speedFlag, vblankFlag};
 
         emulator.runEmulator(std::move(programPath));
     }
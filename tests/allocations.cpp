@@ -0,0 +1,141 @@
+#include <chip8.h>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <utility>
+
+// Checks that, once a rom has been read and an engine has been selected, the execution
+// of the instructions never allocates on the heap. The global operator new is replaced
+// by one that counts the allocations made while counting is true.
+namespace
+{
+    std::atomic<bool> counting {false};
+    std::atomic<uint64_t> allocations {0};
+
+    void* allocate(const std::size_t size, const std::size_t alignment)
+    {
+        if (counting)
+        {
+            ++allocations;
+        }
+
+        // aligned_alloc wants a size that is a multiple of the alignment
+        const std::size_t alignedSize = (size + alignment - 1) / alignment * alignment;
+
+        void* p = (alignment <= alignof(std::max_align_t)) ? std::malloc(size == 0 ? 1 : size)
+                                                          : std::aligned_alloc(alignment, alignedSize);
+        if (p == nullptr)
+        {
+            throw std::bad_alloc {};
+        }
+
+        return p;
+    }
+}
+
+void* operator new(std::size_t size) { return allocate(size, alignof(std::max_align_t)); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocate(size, static_cast<std::size_t>(alignment)); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+namespace
+{
+    // a loop executing every instruction but fx0a (which waits for a key to be pressed)
+    constexpr uint8_t ROM[] {
+        0x00, 0xe0, // 200: cls
+        0x6a, 0x05, // 202: ld va, 5
+        0x7a, 0x01, // 204: add va, 1
+        0x6b, 0x03, // 206: ld vb, 3
+        0x8a, 0xb0, 0x8a, 0xb1, 0x8a, 0xb2, 0x8a, 0xb3, 0x8a, 0xb4, // 208: 8xy0 - 8xy4
+        0x8a, 0xb5, 0x8a, 0xb6, 0x8a, 0xb7, 0x8a, 0xbe, // 212: 8xy5 - 8xye
+        0x9a, 0xb0, // 21a: sne va, vb
+        0x3a, 0x00, // 21c: se va, 0
+        0x4a, 0x00, // 21e: sne va, 0
+        0x5a, 0xb0, // 220: se va, vb
+        0xa3, 0x00, // 222: ld i, 300
+        0xca, 0x0f, // 224: rnd va, 0f
+        0xd0, 0x15, // 226: drw v0, v1, 5
+        0xd0, 0x15, // 228: drw v0, v1, 5
+        0x62, 0x03, // 22a: ld v2, 3
+        0xe2, 0x9e, // 22c: skp v2
+        0xe2, 0xa1, // 22e: sknp v2
+        0xf2, 0x07, // 230: ld v2, dt
+        0xf2, 0x15, // 232: ld dt, v2
+        0xf2, 0x18, // 234: ld st, v2
+        0xf2, 0x1e, // 236: add i, v2
+        0xf2, 0x29, // 238: ld f, v2
+        0xa3, 0x00, // 23a: ld i, 300
+        0xf2, 0x33, // 23c: ld b, v2
+        0xf2, 0x55, // 23e: ld [i], v2
+        0xa3, 0x00, // 240: ld i, 300
+        0xf2, 0x65, // 242: ld v2, [i]
+        0x22, 0x50, // 244: call 250
+        0x60, 0x00, // 246: ld v0, 0
+        0xb2, 0x4c, // 248: jp v0, 24c
+        0x00, 0x00, // 24a: never executed
+        0x12, 0x00, // 24c: jp 200
+        0x00, 0x00,
+        0x00, 0xee  // 250: ret
+    };
+
+    const std::pair<Chip8::Engine, std::string> ENGINES[] {
+        {Chip8::Engine::switchCase, "switchCase"},
+        {Chip8::Engine::dispatchTable, "dispatchTable"},
+        {Chip8::Engine::blockCache, "blockCache"},
+        {Chip8::Engine::jit, "jit"},
+        {Chip8::Engine::recompiled, "recompiled"},
+        {Chip8::Engine::threaded, "threaded"},
+        {Chip8::Engine::fused, "fused"}
+    };
+}
+
+int main()
+{
+    const std::filesystem::path romPath {std::filesystem::temp_directory_path() / "chip8_allocations.ch8"};
+
+    {
+        std::ofstream rom {romPath, std::ofstream::out | std::ofstream::binary};
+        rom.write(reinterpret_cast<const char*>(ROM), sizeof(ROM));
+    }
+
+    bool failed = false;
+
+    for (const auto& [engine, name] : ENGINES)
+    {
+        for (const auto& [instructionSet, drawBehaviour] : {std::pair {"-c", "-c"}, std::pair {"-s", "-w"}})
+        {
+            Chip8 chip8 {instructionSet, drawBehaviour, "-f", []() {}, []() {}};
+            chip8.readFromFile(romPath);
+            chip8.setEngine(engine);
+
+            // the first instructions can initialize some static data (the random generator, the tables...)
+            chip8.runTurbo(Chip8::Budget::instructions, 10'000);
+
+            allocations = 0;
+            counting = true;
+            chip8.runTurbo(Chip8::Budget::instructions, 100'000);
+            counting = false;
+
+            if (allocations != 0)
+            {
+                std::cout << name << " " << instructionSet << " " << drawBehaviour << ": "
+                    << allocations << " allocations" << '\n';
+                failed = true;
+            }
+        }
+    }
+
+    std::filesystem::remove(romPath);
+
+    if (!failed)
+    {
+        std::cout << "no allocations while executing the instructions" << '\n';
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+#include <chip8.h>
+#include <iostream>
+#include <string>
+#include <utility>
+
+// prints how many times the fusion has been found in the rom and how many times it has been executed
+void printFusion(const std::string& name, const Chip8::FusionCounters& counters)
+{
+    std::cout << "        " << name << ": found " << counters.m_found << ", fired " << counters.m_fired << '\n';
+}
+
+// compares the engines on the roms given as arguments:
+// every rom is run by all of them in turbo mode for the same number of instructions
+// and the instructions per second reached by each of them are printed.
+// For the engine fused it also prints which fusions fired and the time they saved
+// with respect to the dispatch table, which executes all the other instructions.
+// The engine recompiled runs as native code only the roms of tests/roms, which are recompiled
+// with the benchmark, and interprets the others
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "usage: benchmark.bin <rom.ch8> [<rom.ch8> ...]" << '\n';
+        return 1;
+    }
+
+    constexpr uint64_t numInstructions {50'000'000};
+
+    const std::pair<Chip8::Engine, std::string> engines[] {
+        {Chip8::Engine::switchCase, "switchCase"},
+        {Chip8::Engine::threaded, "threaded"},
+        {Chip8::Engine::dispatchTable, "dispatchTable"},
+        {Chip8::Engine::fused, "fused"},
+        {Chip8::Engine::recompiled, "recompiled"}
+    };
+
+    for (int i {1}; i < argc; ++i)
+    {
+        std::cout << argv[i] << '\n';
+
+        double switchCaseSpeed {0};
+        double dispatchTableSeconds {0};
+
+        for (const auto& [engine, name] : engines)
+        {
+            Chip8 chip8 {"-chip8", "-clipping", "-n", []() {}, []() {}};
+            chip8.readFromFile(argv[i]);
+            chip8.setEngine(engine);
+
+            // the engines are compared on the instructions they execute, not on the ones they skip
+            chip8.m_skipIdleLoops = false;
+
+            const Chip8::TurboStatistics statistics {chip8.runTurbo(Chip8::Budget::instructions, numInstructions)};
+
+            if (engine == Chip8::Engine::switchCase)
+            {
+                switchCaseSpeed = statistics.m_instructionsPerSecond;
+            }
+
+            if (engine == Chip8::Engine::dispatchTable)
+            {
+                dispatchTableSeconds = statistics.m_seconds;
+            }
+
+            std::cout << "    " << name << ": " << statistics.m_instructionsPerSecond / 1e6 << " millions of instructions per second"
+                << " (" << statistics.m_instructionsPerSecond / switchCaseSpeed << "x switchCase)" << '\n';
+
+            if (engine == Chip8::Engine::fused)
+            {
+                const Chip8::FusionStatistics fusions {chip8.getFusionStatistics()};
+
+                printFusion("6xkk Fx15", fusions.m_loadDelayTimer);
+                printFusion("Fx07 3xkk 1nnn", fusions.m_waitDelayTimer);
+                printFusion("Annn Dxyn", fusions.m_loadIAndDraw);
+
+                std::cout << "        instructions fused: " << fusions.m_fusedInstructions
+                    << ", time saved: " << (dispatchTableSeconds - statistics.m_seconds) * 1e3 << " ms" << '\n';
+            }
+
+            if (engine == Chip8::Engine::recompiled)
+            {
+                const Chip8::RecompiledStatistics recompiled {chip8.getRecompiledStatistics()};
+
+                std::cout << "        blocks: " << recompiled.m_blocks << ", native instructions: " << recompiled.m_nativeInstructions
+                    << ", interpreted: " << recompiled.m_interpretedInstructions
+                    << ", invalidations: " << recompiled.m_invalidations << '\n';
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include <chip8.h>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <utility>
+
+// Checks that every engine executes the roms of tests/roms exactly as the switch:
+// the two chip8 are run side by side by runTurbo in chunks of different lengths
+// and their states are compared after every chunk. The roms don't use cxkk (whose numbers
+// are random) nor fx0a (which waits for a key); two of them write over their own code:
+// - mix.ch8 executes most of the instructions, waiting for the delay timer in an idle loop;
+// - selfmodify55.ch8 writes with fx55 the kk of the add executed at the start of its loop;
+// - selfmodify33.ch8 writes with fx33 the kk of an add and the next instruction (which becomes a 0nnn),
+//   right after the instruction writing them.
+// The roms are recompiled at build time (look at chip8_recompile_rom), so the engine recompiled
+// runs its native blocks until the roms write over them.
+namespace
+{
+    const std::string ROMS[] {"mix.ch8", "selfmodify55.ch8", "selfmodify33.ch8"};
+
+    const std::pair<Chip8::Engine, std::string> ENGINES[] {
+        {Chip8::Engine::dispatchTable, "dispatchTable"},
+        {Chip8::Engine::blockCache, "blockCache"},
+        {Chip8::Engine::jit, "jit"},
+        {Chip8::Engine::recompiled, "recompiled"},
+        {Chip8::Engine::threaded, "threaded"},
+        {Chip8::Engine::fused, "fused"}
+    };
+
+    // the chunks stop the engines in the middle of their blocks, of their fusions and of the frames
+    constexpr uint64_t CHUNKS[] {1, 2, 3, 5, 8, 13, 100, 1'000};
+
+    constexpr uint64_t NUM_INSTRUCTIONS {50'000};
+
+    bool isSameState(const Chip8::State& state1, const Chip8::State& state2)
+    {
+        return std::memcmp(&state1, &state2, sizeof(Chip8::State)) == 0;
+    }
+}
+
+int main()
+{
+    bool failed = false;
+
+    for (const std::string& rom : ROMS)
+    {
+        const std::filesystem::path romPath {std::filesystem::path {CHIP8_TEST_ROMS} / rom};
+
+        for (const auto& [engine, name] : ENGINES)
+        {
+            for (const auto& [instructionSet, drawBehaviour] : {std::pair {"-c", "-c"}, std::pair {"-s", "-w"}})
+            {
+                for (const bool waitForVBlank : {false, true})
+                {
+                    Chip8 reference {instructionSet, drawBehaviour, "-n", []() {}, []() {}};
+                    reference.m_waitForVBlank = waitForVBlank;
+                    reference.readFromFile(romPath);
+
+                    Chip8 chip8 {instructionSet, drawBehaviour, "-n", []() {}, []() {}};
+                    chip8.m_waitForVBlank = waitForVBlank;
+                    chip8.readFromFile(romPath);
+                    chip8.setEngine(engine);
+
+                    // otherwise the engine recompiled would only interpret the rom
+                    if (engine == Chip8::Engine::recompiled && chip8.getRecompiledStatistics().m_blocks == 0)
+                    {
+                        std::cout << rom << " has not been recompiled" << '\n';
+                        failed = true;
+                        break;
+                    }
+
+                    uint64_t instructions {0};
+
+                    for (size_t chunk {0}; instructions < NUM_INSTRUCTIONS; ++chunk)
+                    {
+                        const uint64_t count {CHUNKS[chunk % std::size(CHUNKS)]};
+
+                        reference.runTurbo(Chip8::Budget::instructions, count);
+                        chip8.runTurbo(Chip8::Budget::instructions, count);
+                        instructions += count;
+
+                        if (!isSameState(chip8.saveState(), reference.saveState()))
+                        {
+                            std::cout << rom << " " << name << " " << instructionSet << " " << drawBehaviour
+                                << (waitForVBlank ? " -v" : "") << ": different from switchCase after "
+                                << instructions << " instructions" << '\n';
+                            failed = true;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (!failed)
+    {
+        std::cout << "the engines execute the roms as the switch" << '\n';
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,132 @@
+#include <chip8.h>
+#include <chip8_lite.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Checks that Chip8Lite executes a rom as Chip8: the two are run side by side, frame by frame,
+// with the same keys pressed, and their registers, timers and displays are compared after every frame.
+// The rom doesn't use cxkk, since the two draw their random numbers from different generators.
+// It also checks that a rom too long for the ram doesn't overwrite the rest of the state of Chip8Lite
+namespace
+{
+    // the key 3 is pressed: skp and sknp are executed on it, on 0x13 (which is 3 in its lowest 4 bits)
+    // and on 0xff, which are never pressed; the rest draws a sprite and uses the timers
+    constexpr uint8_t ROM[] {
+        0x60, 0x03, // 200: ld v0, 3
+        0x61, 0x13, // 202: ld v1, 13
+        0x62, 0xff, // 204: ld v2, ff
+        0xe0, 0x9e, // 206: skp v0
+        0x7a, 0x01, // 208: add va, 1
+        0xe1, 0x9e, // 20a: skp v1
+        0x7b, 0x01, // 20c: add vb, 1
+        0xe1, 0xa1, // 20e: sknp v1
+        0x7c, 0x01, // 210: add vc, 1
+        0xe2, 0xa1, // 212: sknp v2
+        0x7d, 0x01, // 214: add vd, 1
+        0xe2, 0x9e, // 216: skp v2
+        0x7e, 0x01, // 218: add ve, 1
+        0x63, 0x05, // 21a: ld v3, 5
+        0xf3, 0x15, // 21c: ld dt, v3
+        0xf3, 0x18, // 21e: ld st, v3
+        0xa2, 0x2c, // 220: ld i, 22c
+        0xd0, 0x15, // 222: drw v0, v1, 5
+        0xf4, 0x07, // 224: ld v4, dt
+        0x8a, 0x44, // 226: add va, v4
+        0x12, 0x06, // 228: jp 206
+        0x00, 0x00,
+        0xf0, 0x90, 0xf0, 0x90, 0xf0 // 22c: sprite
+    };
+
+    constexpr uint8_t PRESSED_KEY {3};
+
+    constexpr uint64_t INSTRUCTIONS_PER_FRAME {10};
+
+    constexpr uint64_t NUM_FRAMES {600};
+
+    // the bytes of the ram after the address 0x200
+    constexpr size_t LONG_ROM_SIZE {4096 - 0x200};
+}
+
+int main()
+{
+    const std::filesystem::path romPath {std::filesystem::temp_directory_path() / "chip8_lite.ch8"};
+
+    {
+        std::ofstream rom {romPath, std::ofstream::out | std::ofstream::binary};
+        rom.write(reinterpret_cast<const char*>(ROM), sizeof(ROM));
+    }
+
+    bool failed = false;
+
+    for (const auto& [instructionSet, drawBehaviour] : {std::pair {"-c", "-c"}, std::pair {"-s", "-w"}})
+    {
+        Chip8 chip8 {instructionSet, drawBehaviour, "-n", []() {}, []() {}};
+        chip8.readFromFile(romPath);
+        chip8.m_speed = {Chip8::SpeedUnit::instructionsPerFrame, INSTRUCTIONS_PER_FRAME};
+        chip8.m_keyboard->press(PRESSED_KEY);
+
+        Chip8Lite lite {instructionSet, drawBehaviour};
+        lite.loadProgram(ROM);
+        lite.setKey(PRESSED_KEY, true);
+
+        for (uint64_t frame {0}; frame < NUM_FRAMES; ++frame)
+        {
+            chip8.runTurbo(Chip8::Budget::frames, 1);
+
+            lite.run(INSTRUCTIONS_PER_FRAME);
+            lite.tickTimers();
+
+            const Chip8::State state {chip8.saveState()};
+            const Chip8Lite::State& liteState {lite.getState()};
+
+            if (state.m_registers != liteState.m_registers || state.m_PC != liteState.m_PC || state.m_I != liteState.m_I ||
+                state.m_SP != liteState.m_SP || state.m_stack != liteState.m_stack ||
+                state.m_delayTimer != liteState.m_delayTimer || state.m_soundTimer != liteState.m_soundTimer ||
+                state.m_display != liteState.m_frame)
+            {
+                std::cout << instructionSet << " " << drawBehaviour << ": Chip8Lite is different from Chip8 after "
+                    << frame + 1 << " frames" << '\n';
+                failed = true;
+                break;
+            }
+        }
+    }
+
+    std::filesystem::remove(romPath);
+
+    // a rom longer than the ram after 0x200 is cut where the ram ends, leaving the rest of the state as it was
+    {
+        const std::filesystem::path longRomPath {std::filesystem::temp_directory_path() / "chip8_lite_long.ch8"};
+
+        {
+            const std::vector<char> longRom(2*LONG_ROM_SIZE, static_cast<char>(0xff));
+
+            std::ofstream rom {longRomPath, std::ofstream::out | std::ofstream::binary};
+            rom.write(longRom.data(), static_cast<std::streamsize>(longRom.size()));
+        }
+
+        Chip8Lite lite {"-c", "-c"};
+        lite.readFromFile(longRomPath);
+
+        const Chip8Lite::State& state {lite.getState()};
+
+        if (state.m_ram.back() != 0xff || state.m_PC != 0x200 || state.m_stack != std::array<uint16_t, 16> {} ||
+            state.m_registers != std::array<uint8_t, 16> {} || state.m_lastPressedKey != Chip8Lite::NO_KEY)
+        {
+            std::cout << "the rom longer than the ram has been copied past the ram" << '\n';
+            failed = true;
+        }
+
+        std::filesystem::remove(longRomPath);
+    }
+
+    if (!failed)
+    {
+        std::cout << "Chip8Lite executes the rom as Chip8" << '\n';
+    }
+
+    return failed ? 1 : 0;
+}
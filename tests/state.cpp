@@ -0,0 +1,253 @@
+#include <chip8.h>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <span>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Checks saveState and loadState: a state saved, run and loaded again must give the same state
+// when it is run again (with every engine), the timers and the vertical blank must go on from the saved ticks
+// when the state is loaded and run in real time, and the states which can't be loaded must be rejected
+namespace
+{
+    // waits for the delay timer, then draws a sprite and plays a sound, forever
+    constexpr uint8_t TIMERS_ROM[] {
+        0x6a, 0x00, // 200: ld va, 0
+        0xa2, 0x30, // 202: ld i, 230
+        0x60, 0x0a, // 204: ld v0, 10
+        0xf0, 0x15, // 206: ld dt, v0
+        0xf1, 0x07, // 208: ld v1, dt
+        0x31, 0x00, // 20a: se v1, 0
+        0x12, 0x08, // 20c: jp 208
+        0x7a, 0x01, // 20e: add va, 1
+        0x8b, 0xa0, // 210: ld vb, va
+        0x8b, 0xb4, // 212: add vb, vb
+        0xda, 0xb3, // 214: drw va, vb, 3
+        0xfa, 0x18, // 216: ld st, va
+        0x12, 0x04, // 218: jp 204
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xf0, 0x90, 0xf0 // 230: sprite
+    };
+
+    // sets the delay timer to 200 and waits
+    constexpr uint8_t DELAY_ROM[] {
+        0x60, 0xc8, // 200: ld v0, 200
+        0xf0, 0x15, // 202: ld dt, v0
+        0x12, 0x04  // 204: jp 204
+    };
+
+    // draws a pixel at every vertical blank (with m_waitForVBlank) and counts the sprites drawn in va
+    constexpr uint8_t VBLANK_ROM[] {
+        0xa2, 0x0a, // 200: ld i, 20a
+        0x6a, 0x00, // 202: ld va, 0
+        0xd0, 0x01, // 204: drw v0, v0, 1
+        0x7a, 0x01, // 206: add va, 1
+        0x12, 0x04, // 208: jp 204
+        0x80        // 20a: sprite
+    };
+
+    const std::pair<Chip8::Engine, std::string> ENGINES[] {
+        {Chip8::Engine::switchCase, "switchCase"},
+        {Chip8::Engine::dispatchTable, "dispatchTable"},
+        {Chip8::Engine::blockCache, "blockCache"},
+        {Chip8::Engine::jit, "jit"},
+        {Chip8::Engine::recompiled, "recompiled"},
+        {Chip8::Engine::threaded, "threaded"},
+        {Chip8::Engine::fused, "fused"}
+    };
+
+    std::filesystem::path writeRom(const std::string& name, const std::span<const uint8_t> rom)
+    {
+        const std::filesystem::path romPath {std::filesystem::temp_directory_path() / name};
+
+        std::ofstream file {romPath, std::ofstream::out | std::ofstream::binary};
+        file.write(reinterpret_cast<const char*>(rom.data()), static_cast<std::streamsize>(rom.size()));
+
+        return romPath;
+    }
+
+    bool isSameState(const Chip8::State& state1, const Chip8::State& state2)
+    {
+        return std::memcmp(&state1, &state2, sizeof(Chip8::State)) == 0;
+    }
+
+    // runs the chip8 in real time for the given duration, as the emulator does
+    void runInRealTime(Chip8& chip8, const std::chrono::milliseconds duration)
+    {
+        std::promise<bool> displayInitialized {};
+        displayInitialized.set_value(true);
+
+        std::thread chip8Thread {[&chip8, &displayInitialized]() { chip8.run(displayInitialized.get_future()); }};
+
+        std::this_thread::sleep_for(duration);
+        chip8.m_isRunning = false;
+
+        chip8Thread.join();
+    }
+}
+
+int main()
+{
+    bool failed = false;
+
+    const std::filesystem::path timersRomPath {writeRom("chip8_state_timers.ch8", TIMERS_ROM)};
+    const std::filesystem::path delayRomPath {writeRom("chip8_state_delay.ch8", DELAY_ROM)};
+    const std::filesystem::path vblankRomPath {writeRom("chip8_state_vblank.ch8", VBLANK_ROM)};
+
+    // save, run, load and run again: the second run must end in the same state as the first one,
+    // also when the state goes through its bytes to another chip8 executing it with another engine
+    for (const auto& [engine, name] : ENGINES)
+    {
+        Chip8 chip8 {"-c", "-c", "-n", []() {}, []() {}};
+        chip8.readFromFile(timersRomPath);
+        chip8.setEngine(engine);
+
+        // the budget stops in the middle of a frame
+        chip8.runTurbo(Chip8::Budget::instructions, 1'003);
+        const Chip8::State saved {chip8.saveState()};
+
+        chip8.runTurbo(Chip8::Budget::instructions, 5'000);
+        const Chip8::State reference {chip8.saveState()};
+
+        if (chip8.loadState(saved) != Chip8::LoadStateResult::loaded)
+        {
+            std::cout << name << ": the saved state has not been loaded" << '\n';
+            failed = true;
+            continue;
+        }
+
+        chip8.runTurbo(Chip8::Budget::instructions, 5'000);
+
+        if (!isSameState(chip8.saveState(), reference))
+        {
+            std::cout << name << ": the state loaded in the same chip8 has been run differently" << '\n';
+            failed = true;
+        }
+
+        std::vector<std::byte> bytes(sizeof(Chip8::State));
+        std::memcpy(bytes.data(), &saved, sizeof(Chip8::State));
+
+        Chip8 other {"-c", "-c", "-n", []() {}, []() {}};
+        other.setEngine(engine);
+
+        if (other.loadState(bytes) != Chip8::LoadStateResult::loaded)
+        {
+            std::cout << name << ": the bytes of the saved state have not been loaded" << '\n';
+            failed = true;
+            continue;
+        }
+
+        other.runTurbo(Chip8::Budget::instructions, 5'000);
+
+        if (!isSameState(other.saveState(), reference))
+        {
+            std::cout << name << ": the state loaded in another chip8 has been run differently" << '\n';
+            failed = true;
+        }
+    }
+
+    // the delay timer saved after some frames must keep decreasing from its value
+    // when the state is run in real time, and be saved again with the ticks reached by run
+    {
+        Chip8 chip8 {"-c", "-c", "-n", []() {}, []() {}};
+        chip8.readFromFile(delayRomPath);
+        chip8.runTurbo(Chip8::Budget::frames, 10);
+
+        const Chip8::State saved {chip8.saveState()};
+
+        Chip8 other {"-c", "-c", "-n", []() {}, []() {}};
+        other.loadState(saved);
+        runInRealTime(other, std::chrono::milliseconds {250});
+
+        const Chip8::State state {other.saveState()};
+
+        if (state.m_ticks <= saved.m_ticks || state.m_delayTimer + (state.m_ticks - saved.m_ticks) != saved.m_delayTimer)
+        {
+            std::cout << "delay timer " << static_cast<int>(saved.m_delayTimer) << " at tick " << saved.m_ticks
+                << " became " << static_cast<int>(state.m_delayTimer) << " at tick " << state.m_ticks << '\n';
+            failed = true;
+        }
+    }
+
+    // a dxyn saved while waiting for the vertical blank must draw at the next tick
+    // when the state is run in real time, not when run reaches the saved tick
+    {
+        Chip8 chip8 {"-c", "-c", "-n", []() {}, []() {}};
+        chip8.m_waitForVBlank = true;
+        chip8.readFromFile(vblankRomPath);
+        chip8.runFrames(600);
+
+        const Chip8::State saved {chip8.saveState()};
+
+        Chip8 other {"-c", "-c", "-n", []() {}, []() {}};
+        other.m_waitForVBlank = true;
+        other.loadState(saved);
+        runInRealTime(other, std::chrono::milliseconds {250});
+
+        // about 15 frames have been run
+        const int sprites {static_cast<uint8_t>(other.saveState().m_registers[0xa] - saved.m_registers[0xa])};
+
+        if (sprites < 5)
+        {
+            std::cout << "only " << sprites << " sprites have been drawn in real time after loading the state" << '\n';
+            failed = true;
+        }
+    }
+
+    // the states which can't be loaded are rejected with the reason
+    {
+        Chip8 chip8 {"-c", "-c", "-n", []() {}, []() {}};
+        Chip8 schip {"-s", "-w", "-n", []() {}, []() {}};
+
+        Chip8::State otherVersion {chip8.saveState()};
+        ++otherVersion.m_version;
+
+        const std::vector<std::byte> tooFewBytes(sizeof(Chip8::State) - 1);
+
+        // the stack pointer and the program counter of a corrupted file would point outside of the chip8
+        Chip8::State corruptedSP {chip8.saveState()};
+        corruptedSP.m_SP = static_cast<uint8_t>(corruptedSP.m_stack.size());
+
+        Chip8::State corruptedPC {chip8.saveState()};
+        corruptedPC.m_PC = static_cast<uint16_t>(corruptedPC.m_ram.size() - 1);
+
+        std::vector<std::byte> corruptedBytes(sizeof(Chip8::State));
+        std::memcpy(corruptedBytes.data(), &corruptedPC, sizeof(Chip8::State));
+
+        const Chip8::State before {chip8.saveState()};
+
+        if (chip8.loadState(schip.saveState()) != Chip8::LoadStateResult::wrongSettings ||
+            chip8.loadState(otherVersion) != Chip8::LoadStateResult::wrongVersion ||
+            chip8.loadState(tooFewBytes) != Chip8::LoadStateResult::wrongSize ||
+            chip8.loadState(corruptedSP) != Chip8::LoadStateResult::invalidState ||
+            chip8.loadState(corruptedBytes) != Chip8::LoadStateResult::invalidState)
+        {
+            std::cout << "a state which can't be loaded has not been rejected for the right reason" << '\n';
+            failed = true;
+        }
+
+        // nothing has been loaded from the rejected states
+        if (!isSameState(chip8.saveState(), before))
+        {
+            std::cout << "a rejected state has changed the chip8" << '\n';
+            failed = true;
+        }
+    }
+
+    std::filesystem::remove(timersRomPath);
+    std::filesystem::remove(delayRomPath);
+    std::filesystem::remove(vblankRomPath);
+
+    if (!failed)
+    {
+        std::cout << "the states are saved and loaded correctly" << '\n';
+    }
+
+    return failed ? 1 : 0;
+}